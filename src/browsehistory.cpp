@@ -19,6 +19,7 @@
 
 
 #include "browsehistory.h"
+#include "core/folderprefetcher.h"
 
 namespace Fm {
 
@@ -28,6 +29,9 @@ BrowseHistory::BrowseHistory():
 }
 
 BrowseHistory::~BrowseHistory() {
+    if(prefetcher_) {
+        prefetcher_->removeCandidates(this);
+    }
 }
 
 void BrowseHistory::add(Fm::FilePath path, int scrollPos) {
@@ -51,12 +55,14 @@ void BrowseHistory::add(Fm::FilePath path, int scrollPos) {
     // add a path and current scroll position to browse history
     items_.push_back(BrowseHistoryItem(path, scrollPos));
     currentIndex_ = items_.size() - 1;
+    updatePrefetch();
 }
 
 void BrowseHistory::setCurrentIndex(int index) {
     if(index >= 0 && static_cast<size_t>(index) < items_.size()) {
         currentIndex_ = index;
         // FIXME: should we emit a signal for the change?
+        updatePrefetch();
     }
 }
 
@@ -67,6 +73,7 @@ bool BrowseHistory::canBackward() const {
 int BrowseHistory::backward() {
     if(canBackward()) {
         --currentIndex_;
+        updatePrefetch();
     }
     return currentIndex_;
 }
@@ -78,6 +85,7 @@ bool BrowseHistory::canForward() const {
 int BrowseHistory::forward() {
     if(canForward()) {
         ++currentIndex_;
+        updatePrefetch();
     }
     return currentIndex_;
 }
@@ -89,5 +97,21 @@ void BrowseHistory::setMaxCount(int maxCount) {
     }
 }
 
+void BrowseHistory::updatePrefetch() {
+    if(!prefetcher_ && !FolderPrefetcher::isEnabled()) {
+        return;
+    }
+    FilePathList paths;
+    if(canForward()) {
+        paths.push_back(items_[currentIndex_ + 1].path());
+    }
+    if(!prefetcher_) {
+        if(paths.empty()) {
+            return;
+        }
+        prefetcher_ = FolderPrefetcher::globalInstance();
+    }
+    prefetcher_->setCandidates(this, std::move(paths));
+}
 
 } // namespace Fm
@@ -23,11 +23,14 @@
 
 #include "libfmqtglobals.h"
 #include <vector>
+#include <memory>
 
 #include "core/filepath.h"
 
 namespace Fm {
 
+class FolderPrefetcher;
+
 // class used to story browsing history of folder views
 // We use this class to replace FmNavHistory provided by libfm since
 // the original Libfm API is hard to use and confusing.
@@ -120,10 +123,15 @@ public:
 
     void setMaxCount(int maxCount);
 
+private:
+    void updatePrefetch();
+
 private:
     std::vector<BrowseHistoryItem> items_;
     int currentIndex_;
     int maxCount_;
+    // loads the next folder in the history, which will probably be opened soon
+    std::shared_ptr<FolderPrefetcher> prefetcher_;
 };
 
 }
@@ -109,6 +109,7 @@ bool BasicFileLauncher::launchPaths(FilePathList paths, GAppLaunchContext* ctx)
     QEventLoop eventLoop;
     auto job = new FileInfoJob{paths};
     job->setAutoDelete(false);  // do not automatically delete the job since we want its results later.
+    job->setInteractive(true);  // the user is waiting for the files to be launched
 
     GObjectPtr<GAppLaunchContext> ctxPtr{ctx};
 
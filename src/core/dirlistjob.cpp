@@ -1,15 +1,207 @@
 #include "dirlistjob.h"
 #include <gio/gio.h>
 #include "fileinfo_p.h"
+#include "fileinfoarena.h"
 #include "gioptrs.h"
 #include <QDebug>
+#include <string>
+#include <unordered_set>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
 
 namespace Fm {
 
 DirListJob::DirListJob(const FilePath& path, Flags _flags, const std::shared_ptr<const HashSet>& cutFilesHashSet):
-    dir_path{path}, flags{_flags}, cutFilesHashSet_{cutFilesHashSet} {
+    dir_path{path}, flags{_flags}, cutFilesHashSet_{cutFilesHashSet}, emit_files_found{false} {
+}
+
+void DirListJob::setIncremental(bool set) {
+    emit_files_found = set;
+}
+
+void DirListJob::addFoundFile(std::shared_ptr<FileInfo> fileInfo, FileInfoList& foundFiles, QElapsedTimer& batchTimer) {
+    if(cutFilesHashSet_
+            && cutFilesHashSet_->count(fileInfo->pathHash()) > 0) {
+        fileInfo->bindCutFiles(cutFilesHashSet_);
+    }
+
+    foundFiles.push_back(std::move(fileInfo));
+
+    // in incremental mode, deliver the files found so far in batches
+    if(emit_files_found
+            && (foundFiles.size() >= maxIncrementalBatchSize
+                || batchTimer.elapsed() >= maxIncrementalBatchDelay)) {
+        if(!isCancelled()) {
+            Q_EMIT filesFound(foundFiles);
+        }
+        foundFiles.clear();
+        batchTimer.restart();
+    }
+}
+
+#ifdef __linux__
+
+// stat() a directory entry relative to the directory fd, using statx() to only request what we need
+static bool statDirEntry(int dirfd, const char* name, struct stat& st, bool followLinks) {
+#ifdef STATX_BASIC_STATS
+    struct statx stx;
+    const unsigned int mask = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE
+                              | STATX_BLOCKS | STATX_ATIME | STATX_MTIME | STATX_CTIME;
+    if(statx(dirfd, name, AT_NO_AUTOMOUNT | (followLinks ? 0 : AT_SYMLINK_NOFOLLOW), mask, &stx) == 0) {
+        memset(&st, 0, sizeof(st));
+        st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        st.st_ino = stx.stx_ino;
+        st.st_mode = stx.stx_mode;
+        st.st_nlink = stx.stx_nlink;
+        st.st_uid = stx.stx_uid;
+        st.st_gid = stx.stx_gid;
+        st.st_size = stx.stx_size;
+        st.st_blksize = stx.stx_blksize;
+        st.st_blocks = stx.stx_blocks;
+        st.st_atime = stx.stx_atime.tv_sec;
+        st.st_mtime = stx.stx_mtime.tv_sec;
+        st.st_ctime = stx.stx_ctime.tv_sec;
+        return true;
+    }
+    if(errno != ENOSYS) {
+        return false;
+    }
+    // the kernel does not support statx(), fallback to fstatat()
+#endif
+    return fstatat(dirfd, name, &st, AT_NO_AUTOMOUNT | (followLinks ? 0 : AT_SYMLINK_NOFOLLOW)) == 0;
+}
+
+// read the target of a symlink which does not fit in PATH_MAX bytes, some filesystems allow it
+static bool readLongSymlink(int dirfd, const char* name, std::string& target) {
+    std::size_t size = 2 * PATH_MAX;
+    for(;;) {
+        target.resize(size);
+        ssize_t len = readlinkat(dirfd, name, &target[0], size);
+        if(len < 0) {
+            return false;
+        }
+        if(std::size_t(len) < size) {
+            target.resize(len);
+            return true;
+        }
+        size *= 2; // truncated again
+    }
+}
+
+// read the names listed in the ".hidden" file of the folder, like GIO does
+static std::unordered_set<std::string> readHiddenFile(int dirfd) {
+    std::unordered_set<std::string> names;
+    int fd = openat(dirfd, ".hidden", O_RDONLY | O_CLOEXEC);
+    if(fd >= 0) {
+        std::string content;
+        char buf[4096];
+        ssize_t len;
+        while((len = read(fd, buf, sizeof(buf))) > 0) {
+            content.append(buf, len);
+        }
+        close(fd);
+        std::string::size_type start = 0;
+        while(start < content.size()) {
+            auto end = content.find('\n', start);
+            if(end == std::string::npos) {
+                end = content.size();
+            }
+            if(end > start) {
+                names.emplace(content, start, end - start);
+            }
+            start = end + 1;
+        }
+    }
+    return names;
+}
+
+// List a local folder with getdents64() and statx() on the directory fd.
+// FileInfo objects are created directly from the stat data, without creating a GFileInfo
+// and without the extra access() calls done by GIO for each file.
+// Returns false if the folder cannot be opened, so the caller can fallback to GIO.
+bool DirListJob::listNativeDir(FileInfoArena& arena, FileInfoList& foundFiles, QElapsedTimer& batchTimer) {
+    auto localPath = dir_path.localPath();
+    int dirfd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirfd < 0) {
+        return false;
+    }
+    const auto hiddenNames = readHiddenFile(dirfd);
+
+    // struct dirent64 of glibc has the same layout as the linux_dirent64 returned by the kernel
+    alignas(struct dirent64) char buf[32 * 1024];
+    while(!isCancelled()) {
+        long len = syscall(SYS_getdents64, dirfd, buf, sizeof(buf));
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            int code = errno;
+            GErrorPtr err{G_IO_ERROR, (unsigned int)g_io_error_from_errno(code), g_strerror(code)};
+            if(emitError(err, ErrorSeverity::MILD) == ErrorAction::ABORT) {
+                cancel();
+            }
+            break;
+        }
+        if(len == 0) { // end of the folder
+            break;
+        }
+        for(long pos = 0; pos < len && !isCancelled();) {
+            auto entry = reinterpret_cast<struct dirent64*>(buf + pos);
+            pos += entry->d_reclen;
+            const char* name = entry->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            struct stat st;
+            if(!statDirEntry(dirfd, name, st, false)) {
+                continue; // the file may have been deleted in the meantime
+            }
+            bool isHidden = (name[0] == '.') || hiddenNames.count(name) > 0;
+            auto fileInfo = arena.create();
+            if(S_ISLNK(st.st_mode)) {
+                char target[PATH_MAX];
+                const char* targetPath = nullptr;
+                std::string longTarget;
+                ssize_t targetLen = readlinkat(dirfd, name, target, sizeof(target));
+                if(targetLen >= 0 && std::size_t(targetLen) < sizeof(target)) {
+                    target[targetLen] = '\0';
+                    targetPath = target;
+                }
+                else if(targetLen >= 0 && readLongSymlink(dirfd, name, longTarget)) { // truncated
+                    targetPath = longTarget.c_str();
+                }
+                struct stat targetStat;
+                bool hasTarget = statDirEntry(dirfd, name, targetStat, true);
+                fileInfo->setFromStat(dirfd, name, st, dir_path, isHidden, targetPath,
+                                      hasTarget ? &targetStat : nullptr);
+            }
+            else {
+                fileInfo->setFromStat(dirfd, name, st, dir_path, isHidden);
+            }
+            addFoundFile(std::move(fileInfo), foundFiles, batchTimer);
+        }
+    }
+    close(dirfd);
+    return true;
+}
+
+#else // !__linux__
+
+bool DirListJob::listNativeDir(FileInfoArena& /*arena*/, FileInfoList& /*foundFiles*/, QElapsedTimer& /*batchTimer*/) {
+    return false;
 }
 
+#endif // __linux__
+
 void DirListJob::exec() {
     GErrorPtr err;
     GFileInfoPtr dir_inf;
@@ -54,80 +246,81 @@ _retry:
     }
 
     FileInfoList foundFiles;
-    /* check if FS is R/O and set attr. into inf */
-    // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
-    err.reset();
-    GFileEnumeratorPtr enu = GFileEnumeratorPtr{
-            g_file_enumerate_children(dir_gfile.get(), defaultGFileInfoQueryAttribs,
-                                      G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
-            false
-    };
-    if(enu) {
-        // qDebug() << "START LISTING:" << dir_path.toString().get();
-        while(!isCancelled()) {
-            err.reset();
-            GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
-            if(inf) {
+    FileInfoArena arena;
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+    // for local folders, use the much cheaper native implementation if detailed info is not needed
+    bool listed = false;
+    if(!(flags & DETAILED) && !isFileSearch && dir_path.isNative()) {
+        listed = listNativeDir(arena, foundFiles, batchTimer);
+    }
+
+    if(!listed) {
+        /* check if FS is R/O and set attr. into inf */
+        // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
+        err.reset();
+        GFileEnumeratorPtr enu = GFileEnumeratorPtr{
+                g_file_enumerate_children(dir_gfile.get(), (flags & DETAILED) ? defaultGFileInfoQueryAttribs : fastGFileInfoQueryAttribs,
+                                          G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
+                false
+        };
+        if(enu) {
+            // qDebug() << "START LISTING:" << dir_path.toString().get();
+            while(!isCancelled()) {
+                err.reset();
+                GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
+                if(inf) {
 #if 0
-                FmPath* dir, *sub;
-                GFile* child;
-                if(G_UNLIKELY(job->flags & FM_DIR_LIST_JOB_DIR_ONLY)) {
-                    /* FIXME: handle symlinks */
-                    if(g_file_info_get_file_type(inf) != G_FILE_TYPE_DIRECTORY) {
-                        g_object_unref(inf);
-                        continue;
+                    FmPath* dir, *sub;
+                    GFile* child;
+                    if(G_UNLIKELY(job->flags & FM_DIR_LIST_JOB_DIR_ONLY)) {
+                        /* FIXME: handle symlinks */
+                        if(g_file_info_get_file_type(inf) != G_FILE_TYPE_DIRECTORY) {
+                            g_object_unref(inf);
+                            continue;
+                        }
                     }
-                }
 #endif
-                // virtual folders may return children not within them
-                // For example: the search:/// URI implemented by libfm might return files from different folders during enumeration.
-                // So here we call g_file_enumerator_get_container() to get the real parent path rather than simply using dir_path.
-                // This is not the behaviour of gio, but the extensions by libfm might do this.
-                // FIXME: after we port these vfs implementation from libfm, we can redesign this.
-                FilePath realParentPath = FilePath{g_file_enumerator_get_container(enu.get()), true};
-                if(isFileSearch) { // this is a file sarch job (search:/// URI)
-                    // FIXME: redesign file search and remove this dirty hack
-                    // the libfm implementation of search:/// URI returns a customized GFile implementation that does not behave normally.
-                    // let's get its actual URI and re-create a normal gio GFile instance from it.
-                    realParentPath = FilePath::fromUri(realParentPath.uri().get());
-                }
+                    // virtual folders may return children not within them
+                    // For example: the search:/// URI implemented by libfm might return files from different folders during enumeration.
+                    // So here we call g_file_enumerator_get_container() to get the real parent path rather than simply using dir_path.
+                    // This is not the behaviour of gio, but the extensions by libfm might do this.
+                    // FIXME: after we port these vfs implementation from libfm, we can redesign this.
+                    FilePath realParentPath = FilePath{g_file_enumerator_get_container(enu.get()), true};
+                    if(isFileSearch) { // this is a file sarch job (search:/// URI)
+                        // FIXME: redesign file search and remove this dirty hack
+                        // the libfm implementation of search:/// URI returns a customized GFile implementation that does not behave normally.
+                        // let's get its actual URI and re-create a normal gio GFile instance from it.
+                        realParentPath = FilePath::fromUri(realParentPath.uri().get());
+                    }
 #if 0
-                if(g_file_info_get_file_type(inf) == G_FILE_TYPE_DIRECTORY)
-                    /* for dir: check if its FS is R/O and set attr. into inf */
-                {
-                    _fm_file_info_job_update_fs_readonly(child, inf, nullptr, nullptr);
-                }
-                fi = fm_file_info_new_from_g_file_data(child, inf, sub);
+                    if(g_file_info_get_file_type(inf) == G_FILE_TYPE_DIRECTORY)
+                        /* for dir: check if its FS is R/O and set attr. into inf */
+                    {
+                        _fm_file_info_job_update_fs_readonly(child, inf, nullptr, nullptr);
+                    }
+                    fi = fm_file_info_new_from_g_file_data(child, inf, sub);
 #endif
-                auto fileInfo = std::make_shared<FileInfo>(inf, FilePath(), realParentPath);
-                if(emit_files_found) {
-                    // Q_EMIT filesFound();
-                }
-
-                if(cutFilesHashSet_
-                        && cutFilesHashSet_->count(fileInfo->path().hash()) > 0) {
-                    fileInfo->bindCutFiles(cutFilesHashSet_);
+                    addFoundFile(arena.create(inf, FilePath(), realParentPath), foundFiles, batchTimer);
                 }
-
-                foundFiles.push_back(std::move(fileInfo));
-            }
-            else {
-                if(err) {
-                    ErrorAction act = emitError(err, ErrorSeverity::MILD);
-                    /* ErrorAction::RETRY is not supported. */
-                    if(act == ErrorAction::ABORT) {
-                        cancel();
+                else {
+                    if(err) {
+                        ErrorAction act = emitError(err, ErrorSeverity::MILD);
+                        /* ErrorAction::RETRY is not supported. */
+                        if(act == ErrorAction::ABORT) {
+                            cancel();
+                        }
                     }
+                    /* otherwise it's EOL */
+                    break;
                 }
-                /* otherwise it's EOL */
-                break;
             }
+            err.reset();
+            g_file_enumerator_close(enu.get(), cancellable().get(), &err);
+        }
+        else {
+            emitError(err, ErrorSeverity::CRITICAL);
         }
-        err.reset();
-        g_file_enumerator_close(enu.get(), cancellable().get(), &err);
-    }
-    else {
-        emitError(err, ErrorSeverity::CRITICAL);
     }
 
     // qDebug() << "END LISTING:" << dir_path.toString().get();
@@ -137,42 +330,4 @@ _retry:
     }
 }
 
-#if 0
-//FIXME: incremental..
-
-static gboolean emit_found_files(gpointer user_data) {
-    /* this callback is called from the main thread */
-    FmDirListJob* job = FM_DIR_LIST_JOB(user_data);
-    /* g_print("emit_found_files: %d\n", g_slist_length(job->files_to_add)); */
-
-    if(g_source_is_destroyed(g_main_current_source())) {
-        return FALSE;
-    }
-    g_signal_emit(job, signals[FILES_FOUND], 0, job->files_to_add);
-    g_slist_free_full(job->files_to_add, (GDestroyNotify)fm_file_info_unref);
-    job->files_to_add = nullptr;
-    job->delay_add_files_handler = 0;
-    return FALSE;
-}
-
-static gpointer queue_add_file(FmJob* fmjob, gpointer user_data) {
-    FmDirListJob* job = FM_DIR_LIST_JOB(fmjob);
-    FmFileInfo* file = FM_FILE_INFO(user_data);
-    /* this callback is called from the main thread */
-    /* g_print("queue_add_file: %s\n", fm_file_info_get_disp_name(file)); */
-    job->files_to_add = g_slist_prepend(job->files_to_add, fm_file_info_ref(file));
-    if(job->delay_add_files_handler == 0)
-        job->delay_add_files_handler = g_timeout_add_seconds_full(G_PRIORITY_LOW,
-                                       1, emit_found_files, g_object_ref(job), g_object_unref);
-    return nullptr;
-}
-
-void fm_dir_list_job_add_found_file(FmDirListJob* job, FmFileInfo* file) {
-    fm_file_info_list_push_tail(job->files, file);
-    if(G_UNLIKELY(job->emit_files_found)) {
-        fm_job_call_main_thread(FM_JOB(job), queue_add_file, file);
-    }
-}
-#endif
-
 } // namespace Fm
@@ -3,6 +3,8 @@
 
 #include "../libfmqtglobals.h"
 #include <mutex>
+#include <cstddef>
+#include <QElapsedTimer>
 #include "job.h"
 #include "filepath.h"
 #include "gobjectptr.h"
@@ -10,6 +12,8 @@
 
 namespace Fm {
 
+class FileInfoArena;
+
 class LIBFM_QT_API DirListJob : public Job {
     Q_OBJECT
 public:
@@ -42,12 +46,22 @@ public:
     }
 
 Q_SIGNALS:
+    // In incremental mode, this is emitted from the worker thread whenever a batch of files is
+    // ready. The batch is bounded by both the number of files and the time since the last batch,
+    // so the first files become available quickly even for huge or slow directories.
+    // files() only contains the files which are not yet emitted by this signal.
+    // NOTE: this signal should be connected with Qt::BlockingQueuedConnection.
     void filesFound(FileInfoList& foundFiles);
 
 protected:
 
     void exec() override;
 
+private:
+    void addFoundFile(std::shared_ptr<FileInfo> fileInfo, FileInfoList& foundFiles, QElapsedTimer& batchTimer);
+
+    bool listNativeDir(FileInfoArena& arena, FileInfoList& foundFiles, QElapsedTimer& batchTimer);
+
 private:
     mutable std::mutex mutex_;
     FilePath dir_path;
@@ -56,8 +70,9 @@ private:
     FileInfoList files_;
     const std::shared_ptr<const HashSet> cutFilesHashSet_;
     bool emit_files_found;
-    // guint delay_add_files_handler;
-    // GSList* files_to_add;
+
+    static constexpr std::size_t maxIncrementalBatchSize = 1000;
+    static constexpr qint64 maxIncrementalBatchDelay = 50; // in milliseconds
 };
 
 } // namespace Fm
@@ -1,6 +1,9 @@
 #include "fileinfo.h"
 #include "fileinfo_p.h"
 #include <gio/gio.h>
+#include <mutex>
+#include <unordered_set>
+#include <algorithm>
 
 namespace Fm {
 
@@ -12,26 +15,91 @@ const char defaultGFileInfoQueryAttribs[] = "standard::*,"
                                             "metadata::emblems,"
                                             "metadata::trust";
 
-FileInfo::FileInfo() {
+// without the content type and the icon, which need to read the files to detect their type
+const char fastGFileInfoQueryAttribs[] = "standard::type,"
+                                         "standard::name,"
+                                         "standard::display-name,"
+                                         "standard::size,"
+                                         "standard::is-hidden,"
+                                         "standard::is-backup,"
+                                         "standard::is-symlink,"
+                                         "standard::symlink-target,"
+                                         "standard::target-uri,"
+                                         "unix::*,"
+                                         "time::*,"
+                                         "access::*,"
+                                         "id::filesystem,"
+                                         "metadata::emblems,"
+                                         "metadata::trust";
+
+FileInfo::FileInfo(): hasCustomDispName_{false}, isTrusted_{false} {
     // FIXME: initialize numeric data members
 }
 
-FileInfo::FileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const FilePath& parentDirPath) {
+FileInfo::FileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const FilePath& parentDirPath): FileInfo{} {
     setFromGFileInfo(inf, filePath, parentDirPath);
 }
 
 FileInfo::~FileInfo() {
 }
 
-void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath& filePath, const FilePath& parentDirPath) {
-    inf_ = inf;
-    filePath_ = filePath;
-    if (filePath_ && filePath_.hasParent()) {
-        dirPath_ = filePath_.parent();
+const std::string& FileInfo::emptyString() {
+    static const std::string empty;
+    return empty;
+}
+
+FilePath FileInfo::internDirPath(const FilePath& dirPath) {
+    static std::mutex mutex;
+    static std::unordered_set<FilePath, FilePathHash> dirPaths;
+    static std::size_t pruneSize = 64;
+    if(!dirPath) {
+        return dirPath;
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = dirPaths.find(dirPath);
+    if(it != dirPaths.end()) {
+        return *it;
+    }
+    if(dirPaths.size() >= pruneSize) {
+        // forget the folders which are not referenced by any FileInfo anymore
+        for(it = dirPaths.begin(); it != dirPaths.end();) {
+            if(g_atomic_int_get(&G_OBJECT(it->gfile().get())->ref_count) == 1) {
+                it = dirPaths.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        pruneSize = std::max(std::size_t(64), dirPaths.size() * 2);
+    }
+    dirPaths.insert(dirPath);
+    return dirPath;
+}
+
+void FileInfo::setDisplayName(const char* dispName) {
+    hasCustomDispName_ = (dispName && name_ != dispName);
+    if(hasCustomDispName_) {
+        dispName_.value = QString::fromUtf8(dispName);
+        dispName_.ready.store(true, std::memory_order_release);
     }
     else {
-        dirPath_ = parentDirPath;
+        dispName_.ready.store(false, std::memory_order_release);
+        dispName_.value = QString();
     }
+}
+
+const QString& FileInfo::decodeDisplayName() const {
+    // FileInfo objects are shared between threads, so only one of them may decode the name
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock{mutex};
+    if(!dispName_.ready.load(std::memory_order_relaxed)) {
+        dispName_.value = QString::fromUtf8(name_.c_str(), name_.size());
+        dispName_.ready.store(true, std::memory_order_release);
+    }
+    return dispName_.value;
+}
+
+void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath& filePath, const FilePath& parentDirPath) {
     const char* tmp, *uri;
     GIcon* gicon;
     GFileType type;
@@ -39,9 +107,32 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
     if (const char * name = g_file_info_get_name(inf.get()))
         name_ = name;
 
-    dispName_ = g_file_info_get_display_name(inf.get());
+    extra_.reset();
+    filePath_ = filePath;
+    const bool hasParent = filePath && filePath.hasParent();
+    if (hasParent) {
+        dirPath_ = internDirPath(filePath.parent());
+    }
+    else {
+        dirPath_ = internDirPath(parentDirPath);
+    }
+    if(filePath_) {
+        auto baseName = filePath_.baseName();
+        if(baseName && name_ != baseName.get()) {
+            extra().baseName = baseName.get();
+        }
+        // native paths are cheap to build from the parent folder and the name, so don't keep them
+        else if(hasParent && dirPath_.isNative()) {
+            filePath_ = FilePath();
+        }
+    }
+
+    // the display name is the same as the name for most local files
+    const char* dispName = g_file_info_get_display_name(inf.get());
+    setDisplayName(dispName);
 
     size_ = g_file_info_get_size(inf.get());
+    inode_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_UNIX_INODE);
 
     tmp = g_file_info_get_content_type(inf.get());
     if(tmp) {
@@ -144,13 +235,13 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
         if(uri) {
             if(g_str_has_prefix(uri, "file:///")) {
                 auto filename = CStrPtr{g_filename_from_uri(uri, nullptr, nullptr)};
-                target_ = filename.get();
+                extra().target = filename.get();
             }
             else {
-                target_ = uri;
+                extra().target = uri;
             }
             if(!mimeType_) {
-                mimeType_ = MimeType::guessFromFileName(target_.c_str());
+                mimeType_ = MimeType::guessFromFileName(extra_->target.c_str());
             }
         }
 
@@ -184,13 +275,13 @@ _file_is_symlink:
         if(uri) {
             if(g_str_has_prefix(uri, "file:///")) {
                 auto filename = CStrPtr{g_filename_from_uri(uri, nullptr, nullptr)};
-                target_ = filename.get();
+                extra().target = filename.get();
             }
             else {
-                target_ = uri;
+                extra().target = uri;
             }
             if(!mimeType_) {
-                mimeType_ = MimeType::guessFromFileName(target_.c_str());
+                mimeType_ = MimeType::guessFromFileName(extra_->target.c_str());
             }
         }
     /* Falls through. */
@@ -263,8 +354,7 @@ _file_is_symlink:
     // g_file_info_get_is_backup() does not cover ".bak" and ".old".
     // NOTE: Here, dispName_ is not modified for desktop entries yet.
     isBackup_ = g_file_info_get_is_backup(inf.get())
-                || dispName_.endsWith(QLatin1String(".bak"))
-                || dispName_.endsWith(QLatin1String(".old"));
+                || (dispName && (g_str_has_suffix(dispName, ".bak") || g_str_has_suffix(dispName, ".old")));
     isNameChangeable_ = true; /* GVFS tends to ignore this attribute */
     isIconChangeable_ = isHiddenChangeable_ = false;
     if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME)) {
@@ -284,7 +374,7 @@ _file_is_symlink:
                     CStrPtr uri{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_URL, nullptr)};
                     if(uri) {
                         isShortcut_ = true;
-                        target_ = uri.get();
+                        extra().target = uri.get();
                     }
                 }
             }
@@ -295,7 +385,7 @@ _file_is_symlink:
             /* Use title of the desktop entry for display */
             CStrPtr displayName{g_key_file_get_locale_string(kf, "Desktop Entry", "Name", nullptr, nullptr)};
             if(displayName) {
-                dispName_ = displayName.get();
+                setDisplayName(displayName.get());
             }
             /* handle 'Hidden' key to set hidden attribute */
             if(!isHidden_) {
@@ -308,6 +398,15 @@ _file_is_symlink:
     if(!icon_ && mimeType_)
         icon_ = mimeType_->icon();
 
+    // only this attribute is needed later, so the GFileInfo is not kept
+    isTrusted_ = false;
+    /* to avoid GIO assertion warning: */
+    if(g_file_info_get_attribute_type(inf.get(), "metadata::trust") == G_FILE_ATTRIBUTE_TYPE_STRING) {
+        if(const auto data = g_file_info_get_attribute_string(inf.get(), "metadata::trust")) {
+            isTrusted_ = (strcmp(data, "true") == 0);
+        }
+    }
+
 #if 0
     GFile* _gf = nullptr;
     GFileAttributeInfoList* list;
@@ -327,6 +426,110 @@ _file_is_symlink:
 #endif
 }
 
+// check the permission bits for the effective user, without calling access() for each file.
+// The access rights of the files owned by the user only depend on their mode, so no system call
+// is needed for most files of the user. For other files, the supplementary groups of the user and
+// the ACLs of the file apply too, so the kernel is asked with faccessat() like GIO does.
+static bool hasAccess(int dirfd, const char* name, const struct stat& st, int mask) {
+    static const uid_t euid = geteuid();
+    if(euid == 0) { // root can read and write everything
+        return (mask & X_OK) == 0 || (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+    }
+    if(st.st_uid == euid) {
+        return ((st.st_mode >> 6) & mask) == (mode_t)mask;
+    }
+    return faccessat(dirfd, name, mask, AT_EACCESS) == 0;
+}
+
+void FileInfo::setFromStat(int dirfd, const char* name, const struct stat& st, const FilePath& parentDirPath, bool isHidden,
+                           const char* symlinkTarget, const struct stat* targetStat) {
+    filePath_ = FilePath();
+    dirPath_ = internDirPath(parentDirPath);
+    name_ = name;
+    if(g_get_filename_charsets(nullptr) && g_utf8_validate(name, -1, nullptr)) {
+        setDisplayName(name); // decoded lazily
+    }
+    else {
+        CStrPtr dispName{g_filename_display_name(name)};
+        setDisplayName(dispName.get());
+    }
+
+    // like GIO, report the attributes of the target for symlinks (if it exists)
+    const bool isLink = S_ISLNK(st.st_mode);
+    const struct stat& info = (isLink && targetStat) ? *targetStat : st;
+    mode_ = info.st_mode;
+    if(isLink) {
+        mode_ &= ~S_IFMT; /* reset type */
+        mode_ |= S_IFLNK; /* set type to symlink */
+    }
+    uid_ = info.st_uid;
+    gid_ = info.st_gid;
+    size_ = info.st_size;
+    inode_ = info.st_ino;
+    mtime_ = info.st_mtime;
+    atime_ = info.st_atime;
+    ctime_ = info.st_ctime;
+    blksize_ = info.st_blksize;
+    blocks_ = info.st_blocks;
+
+    // this is the same format as the "id::filesystem" attribute of GIO for local files
+    char fsId[32];
+    g_snprintf(fsId, sizeof(fsId), "l%" G_GUINT64_FORMAT, (guint64)st.st_dev);
+    filesystemId_ = g_intern_string(fsId);
+
+    extra_.reset();
+    icon_.reset();
+    emblems_.clear();
+    mimeType_.reset();
+    if(S_ISDIR(info.st_mode)) {
+        mimeType_ = MimeType::inodeDirectory();
+    }
+    else if(S_ISCHR(info.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/chardevice");
+    }
+    else if(S_ISBLK(info.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/blockdevice");
+    }
+    else if(S_ISFIFO(info.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/fifo");
+    }
+#ifdef S_ISSOCK
+    else if(S_ISSOCK(info.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/socket");
+    }
+#endif
+    else if(isLink && !targetStat) { // broken symlink
+        mimeType_ = MimeType::fromName("inode/symlink");
+    }
+    else {
+        mimeType_ = MimeType::guessFromFileName(name);
+    }
+    if(isLink && symlinkTarget) {
+        extra().target = symlinkTarget;
+    }
+
+    isShortcut_ = isMountable_ = false;
+    isAccessible_ = hasAccess(dirfd, name, info, R_OK);
+    isWritable_ = hasAccess(dirfd, name, info, W_OK);
+    isDeletable_ = true; /* assume it's deletable */
+    isReadOnly_ = false;
+    /* directories should be writable to be deleted by user */
+    if(S_ISDIR(info.st_mode) && !isWritable_) {
+        isDeletable_ = false;
+    }
+
+    isHidden_ = isHidden;
+    // this is what g_file_info_get_is_backup() reports for local files, plus ".bak" and ".old".
+    isBackup_ = g_str_has_suffix(name, "~")
+                || g_str_has_suffix(name, ".bak")
+                || g_str_has_suffix(name, ".old");
+    isNameChangeable_ = true;
+    isIconChangeable_ = isHiddenChangeable_ = false;
+    isTrusted_ = false;
+
+    icon_ = mimeType_->icon();
+}
+
 void FileInfo::bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet) {
     cutFilesHashSet_ = cutFilesHashSet;
 }
@@ -348,14 +551,14 @@ bool FileInfo::isExecutableType() const {
         /* treat desktop entries as executables if
          they are native and have read permission */
         if(isNative() && (mode_ & (S_IRUSR|S_IRGRP|S_IROTH))) {
-            if(isShortcut() && !target_.empty()) {
+            if(isShortcut() && !target().empty()) {
                 /* handle shortcuts from desktop to menu entries:
                    first check for entries in /usr/share/applications and such
                    which may be considered as a safe desktop entry path
                    then check if that is a shortcut to a native file
                    otherwise it is a link to a file under menu:// */
-                if (!g_str_has_prefix(target_.c_str(), "/usr/share/")) {
-                    auto target = FilePath::fromPathStr(target_.c_str());
+                if (!g_str_has_prefix(target().c_str(), "/usr/share/")) {
+                    auto target = FilePath::fromPathStr(target().c_str());
                     bool is_native = target.isNative();
                     if (is_native) {
                         return true;
@@ -389,15 +592,7 @@ bool FileInfo::isExecutableType() const {
 }
 
 bool FileInfo::isTrustable() const {
-    if(isExecutableType()) {
-        /* to avoid GIO assertion warning: */
-        if(g_file_info_get_attribute_type(inf_.get(), "metadata::trust") == G_FILE_ATTRIBUTE_TYPE_STRING) {
-            if(const auto data = g_file_info_get_attribute_string(inf_.get(), "metadata::trust")) {
-                return (strcmp(data, "true") == 0);
-            }
-        }
-    }
-    return false;
+    return isTrusted_ && isExecutableType();
 }
 
 void FileInfo::setTrustable(bool trust) const {
@@ -407,12 +602,11 @@ void FileInfo::setTrustable(bool trust) const {
     GObjectPtr<GFileInfo> info {g_file_info_new()}; // used to set only this attribute
     if(trust) {
         g_file_info_set_attribute_string(info.get(), "metadata::trust", "true");
-        g_file_info_set_attribute_string(inf_.get(), "metadata::trust", "true");
     }
     else {
         g_file_info_set_attribute(info.get(), "metadata::trust", G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
-        g_file_info_set_attribute(inf_.get(), "metadata::trust", G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
     }
+    isTrusted_ = trust;
     g_file_set_attributes_from_info(path().gfile().get(),
                                     info.get(),
                                     G_FILE_QUERY_INFO_NONE,
@@ -420,6 +614,67 @@ void FileInfo::setTrustable(bool trust) const {
 }
 
 
+#if GLIB_CHECK_VERSION(2, 56, 0)
+// g_file_hash() uses g_str_hash() on the path for local files, this hashes the path of
+// a child without building it. In case this changes, the result is checked once at runtime.
+static guint childPathHash(const char* dirPath, const std::string& name) {
+    guint32 h = 5381;
+    const signed char* p = reinterpret_cast<const signed char*>(dirPath);
+    for(; *p; ++p) {
+        h = (h << 5) + h + *p;
+    }
+    if(p == reinterpret_cast<const signed char*>(dirPath) || p[-1] != '/') {
+        h = (h << 5) + h + '/';
+    }
+    for(p = reinterpret_cast<const signed char*>(name.c_str()); *p; ++p) {
+        h = (h << 5) + h + *p;
+    }
+    return h;
+}
+
+static bool isChildPathHashUsable() {
+    auto path = FilePath::fromLocalPath("/tmp/libfm-qt");
+    return childPathHash("/tmp", "libfm-qt") == path.hash();
+}
+#endif
+
+unsigned int FileInfo::pathHash() const {
+#if GLIB_CHECK_VERSION(2, 56, 0)
+    static const bool childPathHashUsable = isChildPathHashUsable();
+    if(childPathHashUsable && !filePath_ && dirPath_ && dirPath_.isNative()) {
+        if(const char* dirStr = g_file_peek_path(dirPath_.gfile().get())) {
+            return childPathHash(dirStr, name_);
+        }
+    }
+#endif
+    return path().hash();
+}
+
+bool FileInfo::hasPath(const FilePath& other) const {
+#if GLIB_CHECK_VERSION(2, 56, 0)
+    // local paths are canonical, so comparing the strings is enough
+    if(!filePath_ && dirPath_ && other && dirPath_.isNative() && other.isNative()) {
+        const char* dirStr = g_file_peek_path(dirPath_.gfile().get());
+        const char* otherStr = g_file_peek_path(other.gfile().get());
+        if(dirStr && otherStr) {
+            const std::size_t dirLen = strlen(dirStr);
+            if(strncmp(otherStr, dirStr, dirLen) != 0) {
+                return false;
+            }
+            otherStr += dirLen;
+            if(dirLen == 0 || dirStr[dirLen - 1] != '/') {
+                if(*otherStr != '/') {
+                    return false;
+                }
+                ++otherStr;
+            }
+            return name_ == otherStr;
+        }
+    }
+#endif
+    return path() == other;
+}
+
 bool FileInfoList::isSameType() const {
     if(!empty()) {
         auto& item = front();
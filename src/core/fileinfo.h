@@ -34,6 +34,7 @@
 #include <utility>
 #include <string>
 #include <forward_list>
+#include <atomic>
 
 #include "gioptrs.h"
 #include "filepath.h"
@@ -44,6 +45,7 @@
 namespace Fm {
 
 class FileInfoList;
+class FolderSnapshotAccess;
 typedef std::set<unsigned int> HashSet;
 
 class LIBFM_QT_API FileInfo {
@@ -102,8 +104,13 @@ public:
         return mtime_;
     }
 
+    // 0 if the inode number is not available
+    uint64_t inode() const {
+        return inode_;
+    }
+
     const std::string& target() const {
-        return target_;
+        return extra_ ? extra_->target : emptyString();
     }
 
     bool isWritableDirectory() const {
@@ -178,7 +185,7 @@ public:
     }
 
     uint64_t realSize() const {
-        return blksize_ *blocks_;
+        return uint64_t(blksize_) * blocks_;
     }
 
     uint64_t size() const {
@@ -190,7 +197,10 @@ public:
     }
 
     const QString& displayName() const {
-        return dispName_;
+        if(Q_LIKELY(dispName_.ready.load(std::memory_order_acquire))) {
+            return dispName_.value;
+        }
+        return decodeDisplayName();
     }
 
     QString description() const {
@@ -201,12 +211,32 @@ public:
         return filePath_ ? filePath_ : dirPath_ ? dirPath_.child(name_.c_str()) : FilePath::fromPathStr(name_.c_str());
     }
 
+    // The base name of path(), which is usually the same as name(). Unlike path().baseName(),
+    // this does not create a GFile, so it should be preferred in loops over many files.
+    const std::string& baseName() const {
+        return (extra_ && !extra_->baseName.empty()) ? extra_->baseName : name_;
+    }
+
+    // The same as path().hash(), but without creating a GFile for local files.
+    unsigned int pathHash() const;
+
+    // The same as path() == other, but without creating a GFile for local files.
+    bool hasPath(const FilePath& other) const;
+
     const FilePath& dirPath() const {
         return dirPath_;
     }
 
     void setFromGFileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const FilePath& parentDirPath);
 
+    // Set the file info from the result of stat() without querying GIO.
+    // This is much cheaper, but the content type is only guessed from the file name, the access
+    // rights of the files owned by the user are derived from the mode bits, and no custom icons
+    // or GIO metadata are available. dirfd is an open descriptor of the parent folder.
+    // For symlinks, symlinkTarget and targetStat (nullptr for a broken link) describe the target.
+    void setFromStat(int dirfd, const char* name, const struct stat& st, const FilePath& parentDirPath, bool isHidden,
+                     const char* symlinkTarget = nullptr, const struct stat* targetStat = nullptr);
+
     void bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet);
 
     const std::forward_list<std::shared_ptr<const IconInfo>>& emblems() const {
@@ -218,30 +248,80 @@ public:
     void setTrustable(bool trust) const;
 
 private:
-    GObjectPtr<GFileInfo> inf_;
+    friend class FolderSnapshotAccess;
+
+    // The display name is only stored if it differs from the file name (desktop entries,
+    // names in another encoding, remote files). Otherwise it's decoded on first use.
+    struct DisplayName {
+        DisplayName(): ready{false} {
+        }
+
+        DisplayName(const DisplayName& other): ready{false} {
+            *this = other;
+        }
+
+        DisplayName& operator = (const DisplayName& other) {
+            if(other.ready.load(std::memory_order_acquire)) {
+                value = other.value;
+                ready.store(true, std::memory_order_release);
+            }
+            else {
+                ready.store(false, std::memory_order_release);
+                value = QString();
+            }
+            return *this;
+        }
+
+        std::atomic<bool> ready;
+        QString value;
+    };
+
+    const QString& decodeDisplayName() const;
+
+    void setDisplayName(const char* dispName);
+
+    static const std::string& emptyString();
+
+    // the data which most files don't have, only allocated if needed
+    struct Extra {
+        std::string target; /* target of shortcut or mountable. */
+        std::string baseName; /* base name of filePath_ if it's not the same as name_ */
+    };
+
+    Extra& extra() {
+        if(!extra_) {
+            extra_ = std::make_shared<Extra>();
+        }
+        return *extra_;
+    }
+
+    // share the FilePath objects of the parent folders among all FileInfo objects
+    static FilePath internDirPath(const FilePath& dirPath);
+
     std::string name_;
-    QString dispName_;
+    mutable DisplayName dispName_;
 
-    FilePath filePath_;
+    FilePath filePath_; /* only set if it's not dirPath_.child(name_) */
     FilePath dirPath_;
 
-    mode_t mode_;
     const char* filesystemId_;
-    uid_t uid_;
-    gid_t gid_;
     uint64_t size_;
+    uint64_t inode_;
     quint64 mtime_;
     quint64 atime_;
     quint64 ctime_;
-
-    uint64_t blksize_;
     uint64_t blocks_;
 
+    uint32_t blksize_;
+    mode_t mode_;
+    uid_t uid_;
+    gid_t gid_;
+
     std::shared_ptr<const MimeType> mimeType_;
     std::shared_ptr<const IconInfo> icon_;
     std::forward_list<std::shared_ptr<const IconInfo>> emblems_;
 
-    std::string target_; /* target of shortcut or mountable. */
+    std::shared_ptr<Extra> extra_;
 
     bool isShortcut_ : 1; /* TRUE if file is shortcut type */
     bool isMountable_ : 1; /* TRUE if file is mountable type */
@@ -254,6 +334,9 @@ private:
     bool isIconChangeable_ : 1; /* TRUE if icon can be changed */
     bool isHiddenChangeable_ : 1; /* TRUE if hidden can be changed */
     bool isReadOnly_ : 1; /* TRUE if host FS is R/O */
+    bool hasCustomDispName_ : 1; /* TRUE if the display name is not decoded from the name */
+
+    mutable bool isTrusted_; /* "metadata::trust", not in a bit field since it can be changed later */
 
     std::weak_ptr<const HashSet> cutFilesHashSet_;
     // std::vector<std::tuple<int, void*, void(void*)>> extraData_;
@@ -5,6 +5,9 @@ namespace Fm {
 
     extern const char defaultGFileInfoQueryAttribs[];
 
+    // the attributes which are cheap to query, the content type is guessed from the file name
+    extern const char fastGFileInfoQueryAttribs[];
+
 } // namespace Fm
 
 #endif // FILEINFO_P_H
@@ -0,0 +1,36 @@
+#include "fileinfoarena.h"
+#include <algorithm>
+
+namespace Fm {
+
+FileInfoArena::Slab::Slab(std::size_t capacity):
+    storage_{new Storage[capacity]},
+    size_{0},
+    capacity_{capacity} {
+}
+
+FileInfoArena::Slab::~Slab() {
+    for(std::size_t i = 0; i < size_; ++i) {
+        reinterpret_cast<FileInfo*>(&storage_[i])->~FileInfo();
+    }
+}
+
+FileInfoArena::FileInfoArena(std::size_t expectedCount):
+    expectedCount_{expectedCount},
+    nextSlabSize_{minSlabSize} {
+}
+
+void FileInfoArena::newSlab() {
+    std::size_t capacity;
+    if(expectedCount_ > 0) {
+        capacity = std::min(expectedCount_, std::size_t(maxSlabSize));
+        expectedCount_ -= capacity;
+    }
+    else {
+        capacity = nextSlabSize_;
+        nextSlabSize_ = std::min(nextSlabSize_ * 2, std::size_t(maxSlabSize));
+    }
+    slab_ = std::make_shared<Slab>(capacity);
+}
+
+} // namespace Fm
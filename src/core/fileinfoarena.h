@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_FILE_INFO_ARENA_H__
+#define __LIBFM_QT_FM_FILE_INFO_ARENA_H__
+
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <new>
+#include "../libfmqtglobals.h"
+#include "fileinfo.h"
+
+namespace Fm {
+
+/*
+ * Allocates the FileInfo objects created by a job in slabs, instead of making a heap
+ * allocation and a control block for each of them.
+ * The returned shared_ptrs alias the reference-counted slab, so a slab is freed when the
+ * last of its FileInfo objects is released. The slabs are kept small, so a few files which
+ * stay alive (e.g. unchanged files after a reload) only retain a bounded amount of memory.
+ * An arena is not thread-safe and should only be used by the thread creating the objects.
+ */
+class LIBFM_QT_API FileInfoArena {
+public:
+    // expectedCount is the number of objects to be created, if known.
+    // Otherwise the slabs grow from minSlabSize to maxSlabSize.
+    explicit FileInfoArena(std::size_t expectedCount = 0);
+
+    template <typename... Args>
+    std::shared_ptr<FileInfo> create(Args&&... args) {
+        if(!slab_ || slab_->isFull()) {
+            newSlab();
+        }
+        FileInfo* info = new(slab_->nextAddress()) FileInfo(std::forward<Args>(args)...);
+        slab_->commit();
+        return std::shared_ptr<FileInfo>{slab_, info};
+    }
+
+    static constexpr std::size_t minSlabSize = 16;
+    static constexpr std::size_t maxSlabSize = 256;
+
+private:
+    class Slab {
+    public:
+        explicit Slab(std::size_t capacity);
+
+        ~Slab();
+
+        bool isFull() const {
+            return size_ == capacity_;
+        }
+
+        void* nextAddress() {
+            return &storage_[size_];
+        }
+
+        void commit() {
+            ++size_;
+        }
+
+    private:
+        typedef std::aligned_storage<sizeof(FileInfo), alignof(FileInfo)>::type Storage;
+        std::unique_ptr<Storage[]> storage_;
+        std::size_t size_;
+        std::size_t capacity_;
+    };
+
+    void newSlab();
+
+    std::shared_ptr<Slab> slab_;
+    std::size_t expectedCount_;
+    std::size_t nextSlabSize_;
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_FILE_INFO_ARENA_H__
@@ -1,5 +1,6 @@
 #include "fileinfojob.h"
 #include "fileinfo_p.h"
+#include "fileinfoarena.h"
 
 namespace Fm {
 
@@ -11,6 +12,7 @@ FileInfoJob::FileInfoJob(FilePathList paths, FilePathList deletionPaths, const s
 }
 
 void FileInfoJob::exec() {
+    FileInfoArena arena{paths_.size()};
     for(const auto& path: paths_) {
         if(isCancelled()) {
             break;
@@ -27,7 +29,7 @@ void FileInfoJob::exec() {
                 false
             };
             if(inf) {
-                auto fileInfoPtr = std::make_shared<FileInfo>(inf, path);
+                auto fileInfoPtr = arena.create(inf, path);
 
                 // FIXME: this is not elegant
                 if(cutFilesHashSet_
@@ -1,4 +1,5 @@
 #include "fileoperationjob.h"
+#include "ioscheduler.h"
 
 namespace Fm {
 
@@ -50,7 +51,10 @@ double FileOperationJob::progress() const {
 
 FileOperationJob::FileExistsAction FileOperationJob::askRename(const FileInfo &src, const FileInfo &dest, FilePath &newDest) {
     FileExistsAction action = SKIP;
+    // the device is not kept busy while the user decides what to do
+    IOScheduler::suspendCurrentJob();
     Q_EMIT fileExists(src, dest, action, newDest);
+    IOScheduler::resumeCurrentJob();
     return action;
 }
 
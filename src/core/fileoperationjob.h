@@ -24,6 +24,10 @@ public:
 
     explicit FileOperationJob();
 
+    JobExecutor::Pool executorPool() const override {
+        return JobExecutor::Pool::BULK_IO;
+    }
+
     // get total amount of work to do
     bool totalAmount(std::uint64_t& fileSize, std::uint64_t& fileCount) const;
 
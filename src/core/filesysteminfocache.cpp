@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "filesysteminfocache.h"
+#include "filesysteminfojob.h"
+#include <QTimer>
+#include <algorithm>
+
+namespace Fm {
+
+std::mutex FileSystemInfoCache::mutex_;
+std::weak_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance_;
+
+FileSystemInfoCache::FileSystemInfoCache():
+    QObject(),
+    timeToLive_{2000} {
+}
+
+FileSystemInfoCache::~FileSystemInfoCache() {
+    for(auto& item: entries_) {
+        if(item.second.job) {
+            item.second.job->cancel();
+        }
+    }
+}
+
+// static
+std::shared_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto cache = globalInstance_.lock();
+    if(cache == nullptr) {
+        cache = std::make_shared<FileSystemInfoCache>();
+        globalInstance_ = cache;
+    }
+    return cache;
+}
+
+void FileSystemInfoCache::setTimeToLive(int msec) {
+    timeToLive_ = std::max(msec, 0);
+}
+
+void FileSystemInfoCache::query(const char* filesystemId, const FilePath& path, QThread::Priority priority) {
+    auto& entry = entries_[filesystemId];
+    entry.path = path;
+    if(entry.job) { // query again when the running job finishes
+        entry.requestedWhileRunning = true;
+        return;
+    }
+    if(entry.refreshScheduled) {
+        return;
+    }
+    if(entry.lastQuery.isValid() && !entry.lastQuery.hasExpired(timeToLive_)) {
+        // the info is still fresh, query it when it gets outdated
+        entry.refreshScheduled = true;
+        entry.priority = priority;
+        QTimer::singleShot(timeToLive_ - entry.lastQuery.elapsed(), this, [this, filesystemId]() {
+            onRefreshTimeout(filesystemId);
+        });
+        return;
+    }
+    entry.priority = priority;
+    startJob(entry);
+}
+
+bool FileSystemInfoCache::info(const char* filesystemId, uint64_t* totalSize, uint64_t* freeSize) const {
+    auto it = entries_.find(filesystemId);
+    if(it == entries_.end() || !it->second.isAvailable) {
+        return false;
+    }
+    *totalSize = it->second.totalSize;
+    *freeSize = it->second.freeSize;
+    return true;
+}
+
+void FileSystemInfoCache::startJob(Entry& entry) {
+    entry.lastQuery.start();
+    entry.job = new FileSystemInfoJob{entry.path};
+    entry.job->setAutoDelete(true);
+    connect(entry.job, &FileSystemInfoJob::finished, this, &FileSystemInfoCache::onJobFinished, Qt::BlockingQueuedConnection);
+    entry.job->runAsync(entry.priority);
+}
+
+void FileSystemInfoCache::onJobFinished() {
+    FileSystemInfoJob* job = static_cast<FileSystemInfoJob*>(sender());
+    // there are only a few filesystems
+    auto it = std::find_if(entries_.begin(), entries_.end(), [job](const std::pair<const char* const, Entry>& item) {
+        return item.second.job == job;
+    });
+    if(it == entries_.end()) {
+        return;
+    }
+    const char* filesystemId = it->first;
+    auto& entry = it->second;
+    entry.job = nullptr;
+    if(!job->isCancelled()) {
+        entry.isAvailable = job->isAvailable();
+        entry.totalSize = job->size();
+        entry.freeSize = job->freeSize();
+    }
+    if(entry.requestedWhileRunning) {
+        // the filesystem may have changed after the job got its info
+        entry.requestedWhileRunning = false;
+        FilePath path = entry.path;
+        query(filesystemId, path, entry.priority);
+    }
+    if(!job->isCancelled()) {
+        Q_EMIT fileSystemChanged(filesystemId);
+    }
+}
+
+void FileSystemInfoCache::onRefreshTimeout(const char* filesystemId) {
+    auto it = entries_.find(filesystemId);
+    if(it == entries_.end()) {
+        return;
+    }
+    it->second.refreshScheduled = false;
+    if(!it->second.job) {
+        startJob(it->second);
+    }
+}
+
+} // namespace Fm
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_FILE_SYSTEM_INFO_CACHE_H__
+#define __LIBFM_QT_FM_FILE_SYSTEM_INFO_CACHE_H__
+
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+
+#include <QObject>
+#include <QThread>
+#include <QElapsedTimer>
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+
+namespace Fm {
+
+class FileSystemInfoJob;
+
+/*
+ * The size and free space of filesystems, shared by all folders.
+ * Filesystems are identified by an interned string, usually their filesystem id
+ * (see FileInfo::filesystemId()). Each filesystem is queried at most once per
+ * timeToLive(). The queries requested meanwhile are coalesced into a single one,
+ * which is run when the time is up, so the last change is never missed.
+ * Only the main thread should use the cache.
+ */
+class LIBFM_QT_API FileSystemInfoCache: public QObject {
+    Q_OBJECT
+public:
+    explicit FileSystemInfoCache();
+
+    ~FileSystemInfoCache() override;
+
+    static std::shared_ptr<FileSystemInfoCache> globalInstance();
+
+    // Request updating the info of the filesystem, path is any file on it.
+    void query(const char* filesystemId, const FilePath& path, QThread::Priority priority = QThread::InheritPriority);
+
+    // returns false if the info is not known yet, or not available for the filesystem
+    bool info(const char* filesystemId, uint64_t* totalSize, uint64_t* freeSize) const;
+
+    int timeToLive() const {
+        return timeToLive_;
+    }
+
+    void setTimeToLive(int msec);
+
+Q_SIGNALS:
+    // the info of the filesystem was queried
+    void fileSystemChanged(const char* filesystemId);
+
+private Q_SLOTS:
+    void onJobFinished();
+
+private:
+    struct Entry {
+        Entry():
+            isAvailable{false},
+            totalSize{0},
+            freeSize{0},
+            job{nullptr},
+            requestedWhileRunning{false},
+            refreshScheduled{false},
+            priority{QThread::InheritPriority} {
+        }
+
+        FilePath path;
+        bool isAvailable;
+        uint64_t totalSize;
+        uint64_t freeSize;
+        QElapsedTimer lastQuery; // invalid until the first query
+        FileSystemInfoJob* job;
+        bool requestedWhileRunning;
+        bool refreshScheduled;
+        QThread::Priority priority;
+    };
+
+    void startJob(Entry& entry);
+    void onRefreshTimeout(const char* filesystemId);
+
+    std::unordered_map<const char*, Entry> entries_;
+    int timeToLive_;
+
+    static std::weak_ptr<FileSystemInfoCache> globalInstance_;
+    static std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_FILE_SYSTEM_INFO_CACHE_H__
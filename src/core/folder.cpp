@@ -24,12 +24,18 @@
 #include "folder.h"
 #include <string.h>
 #include <cassert>
+#include <unordered_set>
+#include <algorithm>
 #include <QTimer>
 #include <QDebug>
+#include <QMetaMethod>
 
 #include "dirlistjob.h"
-#include "filesysteminfojob.h"
+#include "filesysteminfocache.h"
 #include "fileinfojob.h"
+#include "foldersnapshot.h"
+#include "inotifywatcher.h"
+#include "core/legacy/fm-config.h"
 
 namespace Fm {
 
@@ -38,26 +44,98 @@ QString Folder::cutFilesDirPath_;
 QString Folder::lastCutFilesDirPath_;
 std::shared_ptr<const HashSet> Folder::cutFilesHashSet_;
 std::mutex Folder::mutex_;
+bool Folder::deferContentTest_ = false;
+bool Folder::snapshotCacheEnabled_ = false;
+bool Folder::nativeMonitoringEnabled_ = true;
+int Folder::pollingInterval_ = 10000;
+int Folder::maxPollsPerServer_ = 2;
+std::unordered_map<std::string, int> Folder::pollsPerServer_;
+std::list<std::shared_ptr<Folder>> Folder::retainedFolders_;
+std::size_t Folder::maxRetainedFolders_ = 8;
+std::size_t Folder::maxRetainedMemory_ = 32 * 1024 * 1024;
+
+// the number of files whose detailed info is queried by each background job
+static const std::size_t contentUpgradeBatchSize = 256;
+
+// Reads the snapshot of a folder, which builds the info of every file, in a worker thread.
+class SnapshotLoadJob: public Job {
+public:
+    explicit SnapshotLoadJob(FilePath dirPath, std::shared_ptr<const HashSet> cutFilesHashSet):
+        dirPath_{std::move(dirPath)},
+        cutFilesHashSet_{std::move(cutFilesHashSet)} {
+    }
+
+    const FileInfoList& files() const {
+        return files_;
+    }
+
+protected:
+    void exec() override {
+        FolderSnapshot::load(dirPath_, files_, cutFilesHashSet_);
+    }
+
+private:
+    FilePath dirPath_;
+    std::shared_ptr<const HashSet> cutFilesHashSet_;
+    FileInfoList files_;
+};
+
+// the rate of file monitor events is measured over windows of this length (in ms)
+static const qint64 changeRateWindow = 250;
+// above this rate (events per second), the changes are coalesced
+static const double coalescingEventRate = 20.0;
+// the delay used at coalescingEventRate, it grows with the event rate (in ms)
+static const int minUpdateDelay = 50;
+// the maximum delay before a change is handled (in ms)
+static const int maxUpdateDelay = 1000;
+// the maximum number of FileInfoJobs running for the changes of a folder
+static const std::size_t maxFileInfoJobs = 2;
+// above this number of pending changes, the folder is reloaded instead
+static const std::size_t maxPendingChanges = 2000;
+// the polling interval grows up to this multiple of Folder::pollingInterval() while nothing changes
+static const int maxPollingBackoff = 16;
+// the delay before trying again when too many folders of the same server are polled (in ms)
+static const int pollRetryDelay = 1000;
+// the folder is listed after this number of polls even if its mtime is unchanged,
+// because changing the content of a file does not change the mtime of its folder
+static const unsigned int maxPollsWithoutListing = 4;
 
 Folder::Folder():
+    ioFilesystemId_{nullptr},
     dirlist_job{nullptr},
-    fsInfoJob_{nullptr},
+    contentUpgradeJob_{nullptr},
     volumeManager_{VolumeManager::globalInstance()},
     /* for file monitor */
     has_idle_reload_handler{0},
     has_idle_update_handler{false},
     pending_change_notify{false},
+    reloading_on_overflow{false},
+    eventCount_{0},
+    eventRate_{0.0},
     filesystem_info_pending{false},
-    wants_incremental{false},
+    pollInterval_{0},
+    pollsWithoutListing_{0},
+    pollDirMtime_{0},
+    pollInfoJob_{nullptr},
+    pollListJob_{nullptr},
+    pollSuspended_{false},
+    snapshotLoadJob_{nullptr},
+    reconciling_{false},
+    wants_incremental{true},
+    prefetched_{false},
+    prefetchFailed_{false},
     stop_emission{false}, /* don't set it 1 bit to not lock other bits */
-    /* filesystem info - set in query thread, read in main */
-    fs_total_size{0},
-    fs_free_size{0},
-    has_fs_info{false},
+    fsInfoCache_{FileSystemInfoCache::globalInstance()},
+    fsInfoKey_{nullptr},
+    fsInfoWanted_{false},
     defer_content_test{false} {
 
     connect(volumeManager_.get(), &VolumeManager::mountAdded, this, &Folder::onMountAdded);
     connect(volumeManager_.get(), &VolumeManager::mountRemoved, this, &Folder::onMountRemoved);
+    connect(fsInfoCache_.get(), &FileSystemInfoCache::fileSystemChanged, this, &Folder::onFileSystemChanged);
+
+    pollTimer_.setSingleShot(true);
+    connect(&pollTimer_, &QTimer::timeout, this, &Folder::onPollTimeout);
 }
 
 Folder::Folder(const FilePath& path): Folder() {
@@ -69,6 +147,8 @@ Folder::~Folder() {
         g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
         dirMonitor_.reset();
     }
+    nativeMonitor_.reset();
+    stopPolling();
 
     if(dirlist_job) {
         dirlist_job->cancel();
@@ -79,39 +159,238 @@ Folder::~Folder() {
         job->cancel();
     }
 
-    if(fsInfoJob_) {
-        fsInfoJob_->cancel();
+    if(contentUpgradeJob_) {
+        contentUpgradeJob_->cancel();
+    }
+
+    if(snapshotLoadJob_) {
+        snapshotLoadJob_->cancel();
     }
 
     // We store a weak_ptr instead of shared_ptr in the hash table, so the hash table
     // does not own a reference to the folder. When the last reference to Folder is
     // freed, we need to remove its hash table entry.
+    // NOTE: fromPath() may have replaced the expired entry with a new folder already.
     std::lock_guard<std::mutex> lock{mutex_};
     auto it = cache_.find(dirPath_);
-    if(it != cache_.end()) {
+    if(it != cache_.end() && it->second.expired()) {
         cache_.erase(it);
     }
 }
 
 // static
 std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
+    // Folders evicted from the retained list are released after unlocking the mutex,
+    // because the destructor of Folder needs to lock it too.
+    std::vector<std::shared_ptr<Folder>> evicted;
     std::lock_guard<std::mutex> lock{mutex_};
+    std::shared_ptr<Folder> folder;
     auto it = cache_.find(path);
     if(it != cache_.end()) {
-        auto folder = it->second.lock();
-        if(folder) {
-            return folder;
+        folder = it->second.lock();
+        if(!folder) { // the folder is being destroyed in another thread
+            cache_.erase(it);
         }
-        else { // FIXME: is this possible?
+    }
+    if(!folder) {
+        folder = std::make_shared<Folder>(path);
+        folder->ioFilesystemId_ = findFilesystemId(path, evicted);
+        folder->reload();
+        cache_.emplace(path, folder);
+    }
+    else if(folder->prefetched_) {
+        folder->prefetched_ = false;
+        // The background listing may still be waiting for the jobs of other folders,
+        // and nothing was lost if it has not found any file yet. If it failed, the folder
+        // is listed again so its errors are reported to the user (e.g. to mount it).
+        if(folder->prefetchFailed_ || (folder->dirlist_job && !folder->dirInfo_)) {
+            folder->prefetchFailed_ = false;
+            folder->reload();
+        }
+    }
+    retainFolder(folder, evicted);
+    return folder;
+}
+
+// static
+std::shared_ptr<Folder> Folder::prefetch(const FilePath& path) {
+    // released after unlocking the mutex, like in fromPath()
+    std::vector<std::shared_ptr<Folder>> related;
+    std::lock_guard<std::mutex> lock{mutex_};
+    std::shared_ptr<Folder> folder;
+    auto it = cache_.find(path);
+    if(it != cache_.end()) {
+        folder = it->second.lock();
+        if(!folder) { // the folder is being destroyed in another thread
             cache_.erase(it);
         }
     }
-    auto folder = std::make_shared<Folder>(path);
-    folder->reload();
-    cache_.emplace(path, folder);
+    if(!folder) {
+        folder = std::make_shared<Folder>(path);
+        folder->prefetched_ = true;
+        folder->ioFilesystemId_ = findFilesystemId(path, related);
+        folder->reload();
+        cache_.emplace(path, folder);
+    }
     return folder;
 }
 
+// static
+const char* Folder::knownFilesystemId(const FilePath& path) {
+    // the folders are released after unlocking the mutex, like in fromPath()
+    std::vector<std::shared_ptr<Folder>> related;
+    std::lock_guard<std::mutex> lock{mutex_};
+    return findFilesystemId(path, related);
+}
+
+// mutex_ should be locked, and the folders used are added to the list so they are not destroyed with it locked
+// static
+const char* Folder::findFilesystemId(const FilePath& path, std::vector<std::shared_ptr<Folder>>& folders) {
+    auto cachedFolder = [&folders](const FilePath& folderPath) -> Folder* {
+        auto it = cache_.find(folderPath);
+        if(it == cache_.end()) {
+            return nullptr;
+        }
+        auto folder = it->second.lock();
+        if(!folder) {
+            return nullptr;
+        }
+        folders.push_back(folder);
+        return folder.get();
+    };
+    auto folder = cachedFolder(path);
+    if(folder && folder->dirInfo_) {
+        return folder->dirInfo_->filesystemId();
+    }
+    if(path.hasParent()) {
+        if(auto parent = cachedFolder(path.parent())) {
+            // the file may be a mount point, so its own info is preferred to the parent folder
+            auto file = parent->fileByName(path.baseName().get());
+            if(file) {
+                return file->filesystemId();
+            }
+            if(parent->dirInfo_) {
+                return parent->dirInfo_->filesystemId();
+            }
+        }
+    }
+    return nullptr;
+}
+
+const char* Folder::ioFilesystemId() const {
+    return dirInfo_ ? dirInfo_->filesystemId() : ioFilesystemId_;
+}
+
+// static
+void Folder::retainFolder(const std::shared_ptr<Folder>& folder, std::vector<std::shared_ptr<Folder>>& evicted) {
+    // mark the folder as the most recently used one
+    auto it = std::find(retainedFolders_.begin(), retainedFolders_.end(), folder);
+    if(it != retainedFolders_.end()) {
+        retainedFolders_.splice(retainedFolders_.begin(), retainedFolders_, it);
+    }
+    else {
+        retainedFolders_.push_front(folder);
+    }
+    evictRetainedFolders(maxRetainedFolders_, maxRetainedMemory_, evicted);
+}
+
+// static
+void Folder::evictRetainedFolders(std::size_t maxCount, std::size_t maxMemory, std::vector<std::shared_ptr<Folder>>& evicted) {
+    std::size_t memory = 0;
+    for(const auto& folder: retainedFolders_) {
+        memory += folder->estimatedMemoryUsage();
+    }
+    while(!retainedFolders_.empty() && (retainedFolders_.size() > maxCount || memory > maxMemory)) {
+        auto& folder = retainedFolders_.back();
+        memory -= folder->estimatedMemoryUsage();
+        evicted.push_back(std::move(folder));
+        retainedFolders_.pop_back();
+    }
+}
+
+// static
+void Folder::setRetainedFolderLimits(std::size_t maxCount, std::size_t maxMemory) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{mutex_};
+    maxRetainedFolders_ = maxCount;
+    maxRetainedMemory_ = maxMemory;
+    evictRetainedFolders(maxRetainedFolders_, maxRetainedMemory_, evicted);
+}
+
+// static
+std::size_t Folder::maxRetainedFolders() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxRetainedFolders_;
+}
+
+// static
+std::size_t Folder::maxRetainedMemory() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxRetainedMemory_;
+}
+
+// static
+std::size_t Folder::retainedFolderCount() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return retainedFolders_.size();
+}
+
+// static
+std::size_t Folder::retainedFolderMemory() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    std::size_t memory = 0;
+    for(const auto& folder: retainedFolders_) {
+        memory += folder->estimatedMemoryUsage();
+    }
+    return memory;
+}
+
+// static
+void Folder::trimRetainedFolders(std::size_t maxCount, std::size_t maxMemory) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{mutex_};
+    evictRetainedFolders(maxCount, maxMemory, evicted);
+}
+
+std::size_t Folder::estimatedMemoryUsage() const {
+    // FileInfo objects, hash table nodes and the strings held by them
+    const std::size_t perFile = sizeof(FileInfo) + sizeof(decltype(files_)::value_type) + 4 * sizeof(void*) + 64;
+    return sizeof(Folder) + files_.size() * perFile;
+}
+
+// static
+void Folder::setDeferContentTest(bool defer) {
+    deferContentTest_ = defer;
+    if(fm_config) {
+        fm_config->defer_content_test = deferContentTest_;
+    }
+}
+
+// static
+void Folder::setSnapshotCacheEnabled(bool enabled) {
+    snapshotCacheEnabled_ = enabled;
+}
+
+// static
+void Folder::setNativeMonitoringEnabled(bool enabled) {
+    nativeMonitoringEnabled_ = enabled;
+}
+
+// static
+void Folder::setPollingInterval(int msec) {
+    pollingInterval_ = std::max(msec, 0);
+}
+
+// static
+void Folder::setMaxPollsPerServer(int maxPolls) {
+    maxPollsPerServer_ = std::max(maxPolls, 1);
+}
+
+// virtual folders are generated on the fly, there is no point in saving them
+static bool canUseSnapshot(const FilePath& path) {
+    return !path.hasUriScheme("search") && !path.hasUriScheme("menu");
+}
+
 bool Folder::makeDirectory(const char* /*name*/, GError** /*error*/) {
     // TODO:
     // FIXME: what the API is used for in the original libfm C API?
@@ -143,12 +422,21 @@ bool Folder::isEmpty() const {
 }
 
 FileInfoList Folder::files() const {
-    FileInfoList ret;
-    ret.reserve(files_.size());
-    for(const auto& item : files_) {
-        ret.push_back(item.second);
+    return *filesSnapshot();
+}
+
+std::shared_ptr<const FileInfoList> Folder::filesSnapshot() const {
+    std::lock_guard<std::mutex> lock{filesMutex_};
+    // the snapshot is only rebuilt when it's needed after a change
+    if(!filesSnapshot_) {
+        auto snapshot = std::make_shared<FileInfoList>();
+        snapshot->reserve(files_.size());
+        for(const auto& item : files_) {
+            snapshot->push_back(item.second);
+        }
+        filesSnapshot_ = std::move(snapshot);
     }
-    return ret;
+    return filesSnapshot_;
 }
 
 
@@ -180,6 +468,29 @@ void Folder::init(FmFolder* folder) {
 }
 #endif
 
+void Folder::onSnapshotLoaded() {
+    auto job = static_cast<SnapshotLoadJob*>(sender());
+    if(job != snapshotLoadJob_) { // cancelled by reload()
+        return;
+    }
+    snapshotLoadJob_ = nullptr;
+    // the snapshot is useless if the listing has found some files or finished already
+    if(job->isCancelled() || job->files().empty() || !files_.empty() || !dirlist_job) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{filesMutex_};
+        for(const auto& file: job->files()) {
+            files_[file->baseName()] = file;
+        }
+        filesSnapshot_.reset();
+    }
+    // the files shown now are compared with the listing, and only the differences are emitted
+    reconciling_ = true;
+    reconciledNames_.clear();
+    Q_EMIT filesAdded(job->files());
+}
+
 void Folder::onIdleReload() {
     /* check if folder still exists */
     reload();
@@ -201,6 +512,11 @@ void Folder::onFileInfoFinished() {
     FileInfoJob* job = static_cast<FileInfoJob*>(sender());
     fileinfoJobs_.erase(std::find(fileinfoJobs_.cbegin(), fileinfoJobs_.cend(), job));
 
+    // some changes may be waiting for a free job slot
+    if(!paths_to_add.empty() || !paths_to_update.empty() || !paths_to_del.empty()) {
+        queueUpdate();
+    }
+
     if(job->isCancelled())
         return;
 
@@ -211,6 +527,9 @@ void Folder::onFileInfoFinished() {
     const auto& paths = job->paths();
     const auto& deletionPaths = job->deletionPaths();
     const auto& infos = job->files();
+    // index the deletion paths so checking each path below does not need a linear search
+    const std::unordered_set<FilePath, FilePathHash> deletionPathSet(deletionPaths.cbegin(), deletionPaths.cend());
+    std::unique_lock<std::mutex> lock{filesMutex_};
     auto path_it = paths.cbegin();
     auto info_it = infos.cbegin();
     for(; path_it != paths.cend() && info_it != infos.cend(); ++path_it, ++info_it) {
@@ -221,18 +540,23 @@ void Folder::onFileInfoFinished() {
             dirInfo_ = info;
         }
         // add/update the file only if it isn't going to be deleted
-        else if(std::find(deletionPaths.cbegin(), deletionPaths.cend(), path) == deletionPaths.cend()
-                && std::find(paths_to_del_later.cbegin(), paths_to_del_later.cend(), path) == paths_to_del_later.cend()) {
-            auto it = files_.find(info->path().baseName().get());
+        else if(deletionPathSet.count(path) == 0 && !paths_to_del_later.contains(path)) {
+            const auto& name = info->baseName();
+            auto it = files_.find(name);
             if(it != files_.end()) { // the file already exists, update
                 files_to_update.push_back(std::make_pair(it->second, info));
             }
             else { // newly added
                 files_to_add.push_back(info);
             }
-            files_[info->path().baseName().get()] = info;
+            files_[name] = info;
+            if(reconciling_) { // don't remove it when the folder listing finishes
+                reconciledNames_.insert(name);
+            }
         }
     }
+    filesSnapshot_.reset();
+    lock.unlock();
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
     }
@@ -241,11 +565,13 @@ void Folder::onFileInfoFinished() {
     }
     // deletion should be started now, after the info job is processed but,
     // since info jobs are run asynchronously, it may be completed later
-    for(auto pathIter = paths_to_del_later.begin(); pathIter != paths_to_del_later.end();) {
+    lock.lock();
+    for(auto pathIter = paths_to_del_later.cbegin(); pathIter != paths_to_del_later.cend();) {
         auto name = pathIter->baseName();
         auto it = files_.find(name.get());
         if(it != files_.end()) {
             files_to_delete.push_back(it->second);
+            files_.erase(it);
             pathIter = paths_to_del_later.erase(pathIter);
         }
         else {
@@ -260,13 +586,95 @@ void Folder::onFileInfoFinished() {
             files_.erase(it);
         }
         else { // this path will be deleted later, after another info job
-            paths_to_del_later.push_back(path);
+            paths_to_del_later.push(path);
         }
     }
+    filesSnapshot_.reset();
+    lock.unlock();
     if(!files_to_delete.empty()) {
         Q_EMIT filesRemoved(files_to_delete);
     }
     Q_EMIT contentChanged();
+    if(!dirMonitor_ && !nativeMonitor_) { // the changes found by polling
+        saveSnapshot();
+    }
+}
+
+// Schedule querying the detailed info of the files which were listed with cheap attributes only.
+void Folder::queueContentUpgrade() {
+    contentUpgradeQueue_.clear();
+    FileInfoList infos = files();
+    // Use the default sort order of the views (folders first, then by name),
+    // so the files which are most likely visible get upgraded first.
+    std::sort(infos.begin(), infos.end(), [](const std::shared_ptr<const FileInfo>& a, const std::shared_ptr<const FileInfo>& b) {
+        if(a->isDir() != b->isDir()) {
+            return a->isDir();
+        }
+        return a->displayName().compare(b->displayName(), Qt::CaseInsensitive) < 0;
+    });
+    contentUpgradeQueue_.insert(contentUpgradeQueue_.end(), infos.cbegin(), infos.cend());
+    startNextContentUpgrade();
+}
+
+void Folder::startNextContentUpgrade() {
+    if(contentUpgradeJob_) { // only one job at a time
+        return;
+    }
+    FilePathList paths;
+    contentUpgradeFiles_.clear();
+    while(!contentUpgradeQueue_.empty() && paths.size() < contentUpgradeBatchSize) {
+        auto info = std::move(contentUpgradeQueue_.front());
+        contentUpgradeQueue_.pop_front();
+        // skip the files which were removed or already updated by the file monitor
+        auto it = files_.find(info->baseName());
+        if(it == files_.end() || it->second != info) {
+            continue;
+        }
+        paths.push_back(info->path());
+        contentUpgradeFiles_.emplace(it->first, std::move(info));
+    }
+    if(paths.empty()) {
+        return;
+    }
+    contentUpgradeJob_ = new FileInfoJob{std::move(paths), FilePathList(), hasCutFiles() ? cutFilesHashSet_ : nullptr};
+    contentUpgradeJob_->setAutoDelete(true);
+    contentUpgradeJob_->setIOFilesystemId(ioFilesystemId());
+    connect(contentUpgradeJob_, &FileInfoJob::finished, this, &Folder::onContentUpgradeFinished, Qt::BlockingQueuedConnection);
+    contentUpgradeJob_->runAsync(QThread::LowPriority);
+}
+
+void Folder::onContentUpgradeFinished() {
+    FileInfoJob* job = static_cast<FileInfoJob*>(sender());
+    if(job != contentUpgradeJob_) { // this is an outdated job, ignore!
+        return;
+    }
+    contentUpgradeJob_ = nullptr;
+    if(job->isCancelled()) {
+        return;
+    }
+
+    std::vector<FileInfoPair> changePairs;
+    std::unique_lock<std::mutex> lock{filesMutex_};
+    for(const auto& info: job->files()) {
+        const auto& name = info->baseName();
+        auto it = files_.find(name);
+        auto oldIt = contentUpgradeFiles_.find(name);
+        // replace the info only if the file was not changed while the job is running
+        if(it != files_.end() && oldIt != contentUpgradeFiles_.end() && it->second == oldIt->second) {
+            changePairs.push_back(std::make_pair(it->second, info));
+            it->second = info;
+        }
+    }
+    filesSnapshot_.reset();
+    lock.unlock();
+    contentUpgradeFiles_.clear();
+    if(!changePairs.empty()) {
+        Q_EMIT filesChanged(changePairs);
+    }
+    startNextContentUpgrade();
+    if(!contentUpgradeJob_) { // all files are upgraded
+        saveSnapshot();
+    }
 }
 
 void Folder::processPendingChanges() {
@@ -281,7 +689,19 @@ void Folder::processPendingChanges() {
     }
 
     FileInfoJob* info_job = nullptr;
-    if(!paths_to_update.empty() || !paths_to_add.empty() || !paths_to_del.empty()) {
+    const std::size_t n_pending = paths_to_add.size() + paths_to_update.size() + paths_to_del.size();
+    if(n_pending > maxPendingChanges) {
+        // listing the whole folder again is cheaper than querying so many files one by one,
+        // and the reload only reports the differences.
+        paths_to_update.clear();
+        paths_to_add.clear();
+        paths_to_del.clear();
+        reloading_on_overflow = true;
+        queueReload();
+    }
+    // limit the number of jobs running at the same time, the pending changes
+    // are handled by a single job when one of the running jobs finishes.
+    else if(n_pending > 0 && fileinfoJobs_.size() < maxFileInfoJobs) {
         FilePathList paths, deletionPaths;
         paths.insert(paths.end(), paths_to_add.cbegin(), paths_to_add.cend());
         paths.insert(paths.end(), paths_to_update.cbegin(), paths_to_update.cend());
@@ -295,6 +715,8 @@ void Folder::processPendingChanges() {
     if(info_job) {
         fileinfoJobs_.push_back(info_job);
         info_job->setAutoDelete(true);
+        info_job->setInteractive(true);
+        info_job->setIOFilesystemId(ioFilesystemId());
         connect(info_job, &FileInfoJob::finished, this, &Folder::onFileInfoFinished, Qt::BlockingQueuedConnection);
         info_job->runAsync();
 #if 0
@@ -324,29 +746,71 @@ void Folder::processPendingChanges() {
 void Folder::queueUpdate() {
     // qDebug() << "queue_update:" << !has_idle_handler << paths_to_add.size() << paths_to_update.size() << paths_to_del.size();
     if(!has_idle_update_handler) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        // under sustained churn, wait longer so that more changes are handled by a single job.
+        // The delay is not extended by later events, so it also bounds the latency.
+        QTimer::singleShot(updateDelay(), this, &Folder::processPendingChanges);
         has_idle_update_handler = true;
     }
 }
 
+void Folder::countChangeEvent() {
+    if(!eventRateTimer_.isValid()) {
+        eventRateTimer_.start();
+    }
+    ++eventCount_;
+    const qint64 elapsed = eventRateTimer_.elapsed();
+    if(elapsed >= changeRateWindow) {
+        const double rate = eventCount_ * 1000.0 / elapsed;
+        // smooth the rate, but forget the old one after a quiet period
+        eventRate_ = elapsed > changeRateWindow * 4 ? rate : (eventRate_ + rate) / 2;
+        eventCount_ = 0;
+        eventRateTimer_.restart();
+    }
+}
+
+double Folder::changeEventRate() const {
+    if(!eventRateTimer_.isValid()) {
+        return 0.0;
+    }
+    // the last measured rate is outdated if no event was received for a while
+    const qint64 elapsed = eventRateTimer_.elapsed();
+    if(elapsed > changeRateWindow * 4) {
+        return eventCount_ * 1000.0 / elapsed;
+    }
+    return eventRate_;
+}
+
+int Folder::updateDelay() const {
+    const double rate = changeEventRate();
+    if(rate <= coalescingEventRate) {
+        return 0;
+    }
+    return std::min(maxUpdateDelay, int(rate / coalescingEventRate * minUpdateDelay));
+}
+
+Folder::UpdateMode Folder::updateMode() const {
+    if(reloading_on_overflow) {
+        return UpdateMode::RELOADING;
+    }
+    return updateDelay() > 0 ? UpdateMode::COALESCING : UpdateMode::IMMEDIATE;
+}
+
 
 /* returns true if reference was taken from path */
 bool Folder::eventFileAdded(const FilePath &path) {
     bool added = true;
     // G_LOCK(lists);
     /* make sure that the file is not already queued for addition. */
-    if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
+    if(!paths_to_add.contains(path)) {
         if(files_.find(path.baseName().get()) != files_.end()) { // the file already exists, update instead
-            if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
-                paths_to_update.push_back(path);
-            }
+            paths_to_update.push(path);
         }
         else { // newly added file
-            paths_to_add.push_back(path);
+            paths_to_add.push(path);
         }
         /* bug #3591771: 'ln -fns . test' leave no file visible in folder.
            If it is queued for deletion then cancel that operation */
-        paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
+        paths_to_del.remove(path);
     }
     else
         /* file already queued for adding, don't duplicate */
@@ -364,13 +828,11 @@ bool Folder::eventFileChanged(const FilePath &path) {
     bool added;
     // G_LOCK(lists);
     /* make sure that the file is not already queued for changes, addition or deletion */
-    if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()
-       && std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()
-       && std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
+    if(!paths_to_update.contains(path) && !paths_to_add.contains(path) && !paths_to_del.contains(path)) {
         /* Since this function is called only when a file already exists, even if that file
            isn't included in "files_" yet, it will be soon due to a previous call to queueUpdate().
            So, here, we should queue it for changes regardless of what "files_" may contain. */
-        paths_to_update.push_back(path);
+        paths_to_update.push(path);
         added = true;
         queueUpdate();
     }
@@ -388,16 +850,11 @@ void Folder::eventFileDeleted(const FilePath& path) {
        if it is, remove it from that queue instead of queueing it for deletion.
        Moreover, as was the case with eventFileChanged(), here too queueing
        should be done regardless of what "files_" may contain. */
-    if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
-            paths_to_del.push_back(path);
-        }
-    }
-    else {
-        paths_to_add.erase(std::remove(paths_to_add.begin(), paths_to_add.end(), path), paths_to_add.cend());
+    if(!paths_to_add.remove(path)) {
+        paths_to_del.push(path);
     }
     /* the update queue should be canceled for a file that is going to be deleted */
-    paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path), paths_to_update.cend());
+    paths_to_update.remove(path);
     queueUpdate();
     // G_UNLOCK(lists);
 }
@@ -414,6 +871,7 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
         queueReload();
         break;
     case G_FILE_MONITOR_EVENT_DELETED:
+        FolderSnapshot::remove(dirPath_);
         Q_EMIT removed();
         /* g_debug("folder is deleted"); */
         break;
@@ -424,8 +882,7 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
     case G_FILE_MONITOR_EVENT_CHANGED: {
         std::lock_guard<std::mutex> lock{mutex_};
         pending_change_notify = true;
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), dirPath_) != paths_to_update.cend()) {
-            paths_to_update.push_back(dirPath_);
+        if(paths_to_update.push(dirPath_)) {
             queueUpdate();
         }
         /* g_debug("folder is changed"); */
@@ -451,6 +908,7 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
         "G_FILE_MONITOR_EVENT_PRE_UNMOUNT",
         "G_FILE_MONITOR_EVENT_UNMOUNTED"
     }; */
+    countChangeEvent();
     if(dirPath_ == gf) {
         onDirChanged(evt);
         return;
@@ -478,6 +936,70 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
     }
 }
 
+// the events of the inotify watch, read at once
+void Folder::onNativeChangeEvents(const std::vector<InotifyEvent>& events) {
+    // the queues are locked once for all the events of the files
+    std::unique_lock<std::mutex> lock{mutex_, std::defer_lock};
+    for(const auto& event: events) {
+        countChangeEvent();
+        if(event.name.empty()) { // the folder itself
+            if(lock.owns_lock()) {
+                lock.unlock();
+            }
+            onDirChanged(event.type);
+            if(event.type == G_FILE_MONITOR_EVENT_DELETED || event.type == G_FILE_MONITOR_EVENT_UNMOUNTED) {
+                // the slots of removed() or unmount() may have destroyed this folder,
+                // and the other events of the folder are meaningless anyway
+                return;
+            }
+            continue;
+        }
+        auto path = dirPath_.child(event.name.c_str());
+        if(!lock.owns_lock()) {
+            lock.lock();
+        }
+        switch(event.type) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+            eventFileAdded(path);
+            break;
+        case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+        case G_FILE_MONITOR_EVENT_CHANGED:
+            eventFileChanged(path);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+            eventFileDeleted(path);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// the kernel dropped some events, so the folder is listed again and only the differences are reported
+void Folder::onNativeMonitorOverflow() {
+    countChangeEvent();
+    std::lock_guard<std::mutex> lock{mutex_};
+    paths_to_update.clear();
+    paths_to_add.clear();
+    paths_to_del.clear();
+    reloading_on_overflow = true;
+    queueReload();
+}
+
+// the kernel removed the inotify watch, e.g. the folder was deleted or its filesystem unmounted
+void Folder::onNativeMonitorRemoved() {
+    // without a monitor, unmounting is handled by onMountRemoved() and the folder can be polled
+    nativeMonitor_.reset();
+    auto localPath = dirPath_.localPath();
+    if(localPath && g_file_test(localPath.get(), G_FILE_TEST_IS_DIR)) {
+        // e.g. the mount point is shown again, so list it and watch it again
+        queueReload();
+    }
+    else {
+        startPolling();
+    }
+}
+
 // checks whether there were cut files here
 // and if there were, invalidates this last cut path
 bool Folder::hadCutFilesUnset() {
@@ -502,42 +1024,43 @@ void Folder::setCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet)
     cutFilesHashSet_ = cutFilesHashSet;
 }
 
-void Folder::onDirListFinished() {
-    DirListJob* job = static_cast<DirListJob*>(sender());
-    if(job->isCancelled()) { // this is a cancelled job, ignore!
-        if(job == dirlist_job) {
-            dirlist_job = nullptr;
-            Q_EMIT finishLoading(); // this was the last job until now
-        }
-        return;
-    }
-    dirInfo_ = job->dirInfo();
-
+// merge the files found by the dir listing job into files_ and tell the world
+bool Folder::addListedFiles(const FileInfoList& infos) {
     FileInfoList files_to_add;
     std::vector<FileInfoPair> files_to_update;
-    const auto& infos = job->files();
 
+    std::unique_lock<std::mutex> lock{filesMutex_};
     // with "search://", there is no update for infos and all of them should be added
     if(strcmp(dirPath_.uriScheme().get(), "search") == 0) {
         files_to_add = infos;
         for(auto& file: files_to_add) {
-            files_[file->path().baseName().get()] = file;
+            files_[file->baseName()] = file;
         }
     }
     else {
         auto info_it = infos.cbegin();
         for(; info_it != infos.cend(); ++info_it) {
             const auto& info = *info_it;
-            auto it = files_.find(info->path().baseName().get());
+            const auto& name = info->baseName();
+            auto it = files_.find(name);
+            if(reconciling_) {
+                reconciledNames_.insert(name);
+            }
             if(it != files_.end()) {
+                if(reconciling_ && isSameFile(*it->second, *info)) {
+                    continue; // not changed since the snapshot was taken, keep the old info
+                }
                 files_to_update.push_back(std::make_pair(it->second, info));
+                it->second = info;
             }
             else {
                 files_to_add.push_back(info);
+                files_.emplace(name, info);
             }
-            files_[info->path().baseName().get()] = info;
         }
     }
+    filesSnapshot_.reset();
+    lock.unlock();
 
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
@@ -545,6 +1068,108 @@ void Folder::onDirListFinished() {
     if(!files_to_update.empty()) {
         Q_EMIT filesChanged(files_to_update);
     }
+    return !files_to_add.empty() || !files_to_update.empty();
+}
+
+// Remove the files shown from the snapshot which were not found by the folder listing.
+bool Folder::finishReconciling() {
+    FileInfoList files_to_delete;
+    std::unique_lock<std::mutex> lock{filesMutex_};
+    for(auto it = files_.begin(); it != files_.end();) {
+        if(reconciledNames_.count(it->first) == 0) {
+            files_to_delete.push_back(it->second);
+            it = files_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    filesSnapshot_.reset();
+    lock.unlock();
+    reconciling_ = false;
+    reconciledNames_.clear();
+    if(files_to_delete.empty()) {
+        return false;
+    }
+    Q_EMIT filesRemoved(files_to_delete);
+    return true;
+}
+
+// static
+bool Folder::isSameFile(const FileInfo& a, const FileInfo& b) {
+    // the inode changes if the file is replaced by another one, e.g. on safe saving
+    return a.mtime() == b.mtime()
+            && a.size() == b.size()
+            && (a.inode() == 0 || b.inode() == 0 || a.inode() == b.inode())
+            && a.mode() == b.mode()
+            && a.displayName() == b.displayName();
+}
+
+void Folder::saveSnapshot() {
+    if(snapshotCacheEnabled_ && canUseSnapshot(dirPath_)) {
+        FolderSnapshot::save(dirPath_, filesSnapshot());
+    }
+}
+
+void Folder::onDirListFilesFound(FileInfoList& files) {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job != dirlist_job || job->isCancelled()) { // this batch belongs to an outdated job, ignore!
+        return;
+    }
+    if(!dirInfo_) { // we may want the info while the folder is still loading
+        dirInfo_ = job->dirInfo();
+        if(fsInfoWanted_) {
+            queryFilesystemInfo();
+        }
+    }
+    addListedFiles(files);
+}
+
+void Folder::onDirListError(const GErrorPtr& err, Job::ErrorSeverity severity, Job::ErrorAction& response) {
+    if(prefetched_) {
+        // nobody can handle the error yet, stop the background listing
+        prefetchFailed_ = true;
+        response = Job::ErrorAction::ABORT;
+        return;
+    }
+    Q_EMIT error(err, severity, response);
+}
+
+void Folder::onDirListFinished() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job->isCancelled()) { // this is a cancelled job, ignore!
+        if(job == dirlist_job) {
+            dirlist_job = nullptr;
+            reloading_on_overflow = false;
+            // The listing failed or was aborted after an error (e.g. the folder is now a file).
+            // The files shown before reloading which were not listed may not exist anymore.
+            if(reconciling_) {
+                finishReconciling();
+            }
+            Q_EMIT finishLoading(); // this was the last job until now
+        }
+        return;
+    }
+    dirInfo_ = job->dirInfo();
+    reloading_on_overflow = false;
+    if(fsInfoWanted_) {
+        queryFilesystemInfo();
+    }
+
+    // in incremental mode, only the files not yet delivered by filesFound() are left here
+    addListedFiles(job->files());
+    if(reconciling_) {
+        finishReconciling();
+    }
+
+    if(defer_content_test) {
+        // we got only basic info on content, schedule updating it now
+        // the snapshot is saved after all files are upgraded
+        queueContentUpgrade();
+    }
+    else {
+        saveSnapshot();
+    }
 
 #if 0
     if(dirlist_job->isCancelled() && !wants_incremental) {
@@ -603,26 +1228,209 @@ void Folder::onDirListFinished() {
 
     dirlist_job = nullptr;
     Q_EMIT finishLoading();
+
+    startPolling();
 }
 
-#if 0
+// The folders of the same server share a limited number of concurrent polls.
+static std::string pollServerKey(const FilePath& path) {
+    std::string uri = path.uri().get();
+    auto pos = uri.find("://");
+    if(pos == std::string::npos) {
+        return uri;
+    }
+    return uri.substr(0, uri.find('/', pos + 3)); // scheme://[user@]host[:port]
+}
+
+// The folders only kept alive by the cache of recently used folders or by prefetching are not shown,
+// so they are not polled. FolderModel and DirTreeModel always connect to filesAdded(), but
+// FolderPrefetcher does too, so the prefetched folders are only used once fromPath() is called.
+bool Folder::hasUsers() const {
+    return !prefetched_ && isSignalConnected(QMetaMethod::fromSignal(&Folder::filesAdded));
+}
 
+void Folder::connectNotify(const QMetaMethod& signal) {
+    QObject::connectNotify(signal);
+    if(pollSuspended_ && signal == QMetaMethod::fromSignal(&Folder::filesAdded)) {
+        // the folder was not polled for a while, so poll it now
+        pollSuspended_ = false;
+        QTimer::singleShot(0, this, [this]() {
+            if(!pollTimer_.isActive() && !pollInfoJob_ && !pollListJob_) {
+                pollInterval_ = pollingInterval_;
+                onPollTimeout();
+            }
+        });
+    }
+}
 
-void on_dirlist_job_files_found(FmDirListJob* job, GSList* files, gpointer user_data) {
-    FmFolder* folder = FM_FOLDER(user_data);
-    GSList* l;
-    for(l = files; l; l = l->next) {
-        FmFileInfo* file = FM_FILE_INFO(l->data);
-        fm_file_info_list_push_tail(files, file);
+void Folder::startPolling() {
+    if(pollingInterval_ <= 0 || dirMonitor_ || nativeMonitor_ || !canUseSnapshot(dirPath_)) {
+        return;
+    }
+    pollInterval_ = pollingInterval_;
+    pollsWithoutListing_ = 0;
+    pollDirMtime_ = dirInfo_ ? dirInfo_->mtime() : 0;
+    pollTimer_.start(pollInterval_);
+}
+
+void Folder::stopPolling() {
+    pollTimer_.stop();
+    pollSuspended_ = false;
+    // the finished() signals of the cancelled jobs are ignored
+    if(pollInfoJob_) {
+        pollInfoJob_->cancel();
+        pollInfoJob_ = nullptr;
+    }
+    if(pollListJob_) {
+        pollListJob_->cancel();
+        pollListJob_ = nullptr;
     }
-    if(G_UNLIKELY(!dir_fi && job->dir_fi))
-        /* we may want info while folder is still loading */
+    releasePollSlot();
+}
+
+void Folder::schedulePoll(bool changed) {
+    if(pollingInterval_ <= 0) {
+        return;
+    }
+    if(changed) {
+        pollInterval_ = pollingInterval_;
+    }
+    else { // back off while the folder does not change
+        pollInterval_ = std::min(pollInterval_ * 2, pollingInterval_ * maxPollingBackoff);
+    }
+    pollTimer_.start(pollInterval_);
+}
+
+bool Folder::acquirePollSlot() {
+    auto server = pollServerKey(dirPath_);
+    int& polls = pollsPerServer_[server];
+    if(polls >= maxPollsPerServer_) {
+        return false;
+    }
+    ++polls;
+    pollServer_ = std::move(server);
+    return true;
+}
+
+void Folder::releasePollSlot() {
+    if(pollServer_.empty()) {
+        return;
+    }
+    auto it = pollsPerServer_.find(pollServer_);
+    if(it != pollsPerServer_.end() && --it->second <= 0) {
+        pollsPerServer_.erase(it);
+    }
+    pollServer_.clear();
+}
+
+void Folder::onPollTimeout() {
+    if(pollingInterval_ <= 0) {
+        return;
+    }
+    if(dirlist_job || pollInfoJob_ || pollListJob_) { // the folder is being listed already
+        pollTimer_.start(pollInterval_);
+        return;
+    }
+    if(!hasUsers()) { // nobody shows the folder, poll it again when it's used
+        pollSuspended_ = true;
+        return;
+    }
+    if(!acquirePollSlot()) { // too many folders of this server are being polled
+        pollTimer_.start(pollRetryDelay);
+        return;
+    }
+    if(pollDirMtime_ == 0 || pollsWithoutListing_ >= maxPollsWithoutListing) {
+        // the mtime of the folder is not available, or it was trusted for too long
+        startPollListing();
+        return;
+    }
+    // only query the folder itself first, it's much cheaper than listing it
+    pollInfoJob_ = new FileInfoJob{FilePathList{dirPath_}};
+    pollInfoJob_->setAutoDelete(true);
+    pollInfoJob_->setIOFilesystemId(ioFilesystemId());
+    connect(pollInfoJob_, &FileInfoJob::finished, this, &Folder::onPollInfoFinished, Qt::BlockingQueuedConnection);
+    pollInfoJob_->runAsync(QThread::LowPriority);
+}
+
+void Folder::onPollInfoFinished() {
+    FileInfoJob* job = static_cast<FileInfoJob*>(sender());
+    if(job != pollInfoJob_) { // cancelled by stopPolling()
+        return;
+    }
+    pollInfoJob_ = nullptr;
+    if(job->isCancelled() || job->files().empty()) { // the server may be unreachable, try again later
+        releasePollSlot();
+        schedulePoll(false);
+        return;
+    }
+    auto mtime = job->files().front()->mtime();
+    if(mtime != 0 && mtime == pollDirMtime_) { // no file was added, removed or renamed
+        ++pollsWithoutListing_;
+        releasePollSlot();
+        schedulePoll(false);
+        return;
+    }
+    startPollListing(); // the poll slot is kept
+}
+
+void Folder::startPollListing() {
+    pollsWithoutListing_ = 0;
+    // only the changes are looked for, the changed files are queried in detail afterwards
+    pollListJob_ = new DirListJob(dirPath_, DirListJob::FAST, hasCutFiles() ? cutFilesHashSet_ : nullptr);
+    pollListJob_->setAutoDelete(true);
+    pollListJob_->setIOFilesystemId(ioFilesystemId());
+    pollListJob_->setIncremental(false);
+    connect(pollListJob_, &DirListJob::finished, this, &Folder::onPollListFinished, Qt::BlockingQueuedConnection);
+    pollListJob_->runAsync(QThread::LowPriority);
+}
+
+void Folder::onPollListFinished() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job != pollListJob_) { // cancelled by stopPolling()
+        return;
+    }
+    pollListJob_ = nullptr;
+    releasePollSlot();
+    if(job->isCancelled()) { // listing failed, keep the files shown until the next poll
+        schedulePoll(false);
+        return;
+    }
+    if(job->dirInfo()) {
+        dirInfo_ = job->dirInfo();
+        pollDirMtime_ = dirInfo_->mtime();
+    }
+
+    /* The cheap listing is only used to find the files which were added, changed or removed.
+     * Like the changes reported by a file monitor, they are queued, so the added and changed
+     * files are queried with all the details by a FileInfoJob and their types are not guessed. */
+    bool changed = false;
     {
-        dir_fi = fm_file_info_ref(job->dir_fi);
+        std::lock_guard<std::mutex> lock{mutex_};
+        std::unordered_set<std::string> listedNames;
+        for(const auto& info: job->files()) {
+            const auto& name = info->baseName();
+            listedNames.insert(name);
+            auto it = files_.find(name);
+            if(it == files_.end()) {
+                changed = eventFileAdded(dirPath_.child(name.c_str())) || changed;
+            }
+            else if(!isSameFile(*it->second, *info)) {
+                changed = eventFileChanged(dirPath_.child(name.c_str())) || changed;
+            }
+        }
+        for(const auto& item: files_) {
+            if(listedNames.count(item.first) == 0) {
+                eventFileDeleted(dirPath_.child(item.first.c_str()));
+                changed = true;
+            }
+        }
     }
-    g_signal_emit(folder, signals[FILES_ADDED], 0, files);
+    schedulePoll(changed);
 }
 
+#if 0
+
+
 ErrorAction on_dirlist_job_error(FmDirListJob* job, GError* err, FmJobErrorSeverity severity, FmFolder* folder) {
     guint ret;
     /* it's possible that some signal handlers tries to free the folder
@@ -658,6 +1466,8 @@ void Folder::reload() {
         g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
         dirMonitor_.reset();
     }
+    nativeMonitor_.reset();
+    stopPolling();
 
     /* clear all update-lists now, see SF bug #919 - if update comes before
        listing job is finished, a duplicate may be created in the folder */
@@ -676,11 +1486,23 @@ void Folder::reload() {
         fileinfoJobs_.clear();
     }
 
-    /* remove all existing files */
-    if(!files_.empty()) {
-        // FIXME: this is not very efficient :(
+    // cancel the deferred content test of the previous listing
+    if(contentUpgradeJob_) {
+        contentUpgradeJob_->cancel();
+        contentUpgradeJob_ = nullptr;
+    }
+    contentUpgradeQueue_.clear();
+    contentUpgradeFiles_.clear();
+
+    /* The existing files are kept, and compared with the new listing when it finishes.
+     * Files from "search://" do not have unique names, so remove all of them instead. */
+    if(!files_.empty() && dirPath_.hasUriScheme("search")) {
         auto tmp = files();
-        files_.clear();
+        {
+            std::lock_guard<std::mutex> lock{filesMutex_};
+            files_.clear();
+            filesSnapshot_.reset();
+        }
         Q_EMIT filesRemoved(tmp);
     }
 
@@ -693,41 +1515,73 @@ void Folder::reload() {
 
     dirInfo_.reset(); // clear dir info
 
-    /* also re-create a new file monitor */
-    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
-    // FIXME: should we make this cancellable?
-    dirMonitor_ = GFileMonitorPtr{
-            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
-            false
-    };
+    // on the first load, show the content of the last snapshot until the folder is listed.
+    // It's read in a worker thread, so neither the caller (which may hold mutex_) nor the
+    // main thread waits for it.
+    reconciledNames_.clear();
+    if(snapshotLoadJob_) {
+        snapshotLoadJob_->cancel(); // its finished() signal is ignored
+        snapshotLoadJob_ = nullptr;
+    }
+    if(files_.empty() && snapshotCacheEnabled_ && canUseSnapshot(dirPath_)) {
+        snapshotLoadJob_ = new SnapshotLoadJob{dirPath_, hasCutFiles() ? cutFilesHashSet_ : nullptr};
+        snapshotLoadJob_->setAutoDelete(true);
+        snapshotLoadJob_->setInteractive(!prefetched_);
+        connect(snapshotLoadJob_, &Job::finished, this, &Folder::onSnapshotLoaded, Qt::BlockingQueuedConnection);
+        snapshotLoadJob_->runAsync();
+    }
+    // the files shown now are compared with the listing, and only the differences are emitted
+    reconciling_ = !files_.empty();
 
-    if(dirMonitor_) {
-        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+    /* also re-create a new file monitor */
+    if(nativeMonitoringEnabled_ && dirPath_.isNative()) {
+        nativeMonitor_ = InotifyWatcher::globalInstance()->addWatch(dirPath_,
+            [this](const std::vector<InotifyEvent>& events) {
+                onNativeChangeEvents(events);
+            },
+            [this]() {
+                onNativeMonitorOverflow();
+            },
+            [this]() {
+                onNativeMonitorRemoved();
+            });
     }
-    else {
-        qDebug("file monitor cannot be created: %s", err->message);
-        g_error_free(err);
+    if(!nativeMonitor_) { // not a local folder, or inotify cannot be used
+        // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
+        // FIXME: should we make this cancellable?
+        dirMonitor_ = GFileMonitorPtr{
+                g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
+                false
+        };
+
+        if(dirMonitor_) {
+            g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+        }
+        else {
+            qDebug("file monitor cannot be created: %s", err->message);
+            g_error_free(err);
+        }
     }
 
     Q_EMIT contentChanged();
 
     /* run a new dir listing job */
-    // FIXME:
-    // defer_content_test = fm_config->defer_content_test;
+    // only the listing of local folders is cheaper without the content test
+    defer_content_test = deferContentTest_ && dirPath_.isNative();
     dirlist_job = new DirListJob(dirPath_, defer_content_test ? DirListJob::FAST : DirListJob::DETAILED,
                                  hasCutFiles() ? cutFilesHashSet_ : nullptr);
     dirlist_job->setAutoDelete(true);
-    connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
+    // the content of the folder is shown to the user, unless it's only prefetched
+    dirlist_job->setInteractive(!prefetched_);
+    dirlist_job->setIOFilesystemId(ioFilesystemId());
+    connect(dirlist_job, &DirListJob::error, this, &Folder::onDirListError, Qt::BlockingQueuedConnection);
     connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::BlockingQueuedConnection);
-
-#if 0
+    dirlist_job->setIncremental(wants_incremental);
     if(wants_incremental) {
-        g_signal_connect(dirlist_job, "files-found", G_CALLBACK(on_dirlist_job_files_found), folder);
+        connect(dirlist_job, &DirListJob::filesFound, this, &Folder::onDirListFilesFound, Qt::BlockingQueuedConnection);
     }
-    fm_dir_list_job_set_incremental(dirlist_job, wants_incremental);
-#endif
 
-    dirlist_job->runAsync();
+    dirlist_job->runAsync(prefetched_ ? QThread::LowPriority : QThread::InheritPriority);
 
     /* also reload filesystem info.
      * FIXME: is this needed? */
@@ -768,41 +1622,37 @@ bool Folder::is_incremental(FmFolder* folder) {
 #endif
 
 bool Folder::getFilesystemInfo(uint64_t* total_size, uint64_t* free_size) const {
-    if(has_fs_info) {
-        *total_size = fs_total_size;
-        *free_size = fs_free_size;
-        return true;
-    }
-    return false;
+    return fsInfoKey_ && fsInfoCache_->info(fsInfoKey_, total_size, free_size);
 }
 
-
-void Folder::onFileSystemInfoFinished() {
-    FileSystemInfoJob* job = static_cast<FileSystemInfoJob*>(sender());
-    if(job->isCancelled() || job != fsInfoJob_) { // this is a cancelled job, ignore!
-        fsInfoJob_ = nullptr;
-        has_fs_info = false;
-        return;
+void Folder::onFileSystemChanged(const char* filesystemId) {
+    if(filesystemId == fsInfoKey_) {
+        filesystem_info_pending = true;
+        queueUpdate();
     }
-    has_fs_info = job->isAvailable();
-    fs_total_size = job->size();
-    fs_free_size = job->freeSize();
-    filesystem_info_pending = true;
-    fsInfoJob_ = nullptr;
-    queueUpdate();
 }
 
-
 void Folder::queryFilesystemInfo() {
-    // G_LOCK(query);
-    if(fsInfoJob_)
+    // the info is shared by the folders of the same filesystem, so the filesystem id is needed first
+    if(!dirInfo_) {
+        fsInfoWanted_ = true;
         return;
-    fsInfoJob_ = new FileSystemInfoJob{dirPath_};
-    fsInfoJob_->setAutoDelete(true);
-    connect(fsInfoJob_, &FileSystemInfoJob::finished, this, &Folder::onFileSystemInfoFinished, Qt::BlockingQueuedConnection);
-
-    fsInfoJob_->runAsync();
-    // G_UNLOCK(query);
+    }
+    fsInfoWanted_ = false;
+    const char* key = dirInfo_->filesystemId();
+    if(!key) {
+        key = g_intern_string(dirPath_.uri().get());
+    }
+    if(key != fsInfoKey_) {
+        fsInfoKey_ = key;
+        uint64_t total_size, free_size;
+        if(fsInfoCache_->info(fsInfoKey_, &total_size, &free_size)) {
+            // another folder of the filesystem got the info already
+            filesystem_info_pending = true;
+            queueUpdate();
+        }
+    }
+    fsInfoCache_->query(fsInfoKey_, dirPath_, prefetched_ ? QThread::LowPriority : QThread::InheritPriority);
 }
 
 
@@ -920,8 +1770,8 @@ void Folder::onMountRemoved(const Mount& mnt) {
      * GFileMonitor does not support remote filesystems at all.
      * So here is the side effect, no unmount notifications.
      * We need to generate the signal ourselves. */
-    if(!dirMonitor_) {
-        // this is only needed when we don't have a GFileMonitor
+    if(!dirMonitor_ && !nativeMonitor_) {
+        // this is only needed when we don't have a GFileMonitor or an inotify watch
         auto mountRoot = mnt.root();
         if(mountRoot.isPrefixOf(dirPath_)) {
             // if the current folder is under the unmounted path, generate the event ourselves
@@ -24,12 +24,17 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include <list>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 #include <functional>
 
 #include <QObject>
 #include <QtGlobal>
+#include <QElapsedTimer>
+#include <QTimer>
 #include "../libfmqtglobals.h"
 
 #include "gioptrs.h"
@@ -40,13 +45,21 @@
 namespace Fm {
 
 class DirListJob;
-class FileSystemInfoJob;
+class FileSystemInfoCache;
 class FileInfoJob;
+class InotifyWatch;
+struct InotifyEvent;
 
 
 class LIBFM_QT_API Folder: public QObject {
     Q_OBJECT
 public:
+    // how the changes reported by the file monitor are currently handled
+    enum class UpdateMode {
+        IMMEDIATE,  // each change is handled in the next event loop iteration
+        COALESCING, // the changes are collected for a while, because many of them are received
+        RELOADING   // there were too many changes, the folder is listed again instead
+    };
 
     explicit Folder();
 
@@ -56,6 +69,37 @@ public:
 
     static std::shared_ptr<Folder> fromPath(const FilePath& path);
 
+    // Like fromPath(), but a new folder is listed by background jobs, and it's not retained.
+    // It's used to load the folders which will probably be opened soon. If the folder is then
+    // obtained by fromPath() before its listing has started, it's listed again interactively.
+    static std::shared_ptr<Folder> prefetch(const FilePath& path);
+
+    // The filesystem id of a path if it's already known by a loaded folder, without doing any I/O.
+    // It's the id of the folder itself or of the file in its parent folder, otherwise nullptr.
+    // It's used to schedule the jobs working on the path (see Job::setIOFilesystemId()).
+    static const char* knownFilesystemId(const FilePath& path);
+
+    // The most recently used folders are kept alive and monitored even when nobody else
+    // uses them anymore, so going back to them does not need to reload their content.
+    // The retained folders are limited by their number and by their estimated memory usage,
+    // and the least recently used ones are released first.
+    static void setRetainedFolderLimits(std::size_t maxCount, std::size_t maxMemory);
+
+    static std::size_t maxRetainedFolders();
+
+    static std::size_t maxRetainedMemory();
+
+    static std::size_t retainedFolderCount();
+
+    static std::size_t retainedFolderMemory();
+
+    // Release the least recently used folders until the given limits are met.
+    // This does not change the limits used by fromPath().
+    static void trimRetainedFolders(std::size_t maxCount, std::size_t maxMemory);
+
+    // A rough estimate of the memory used by the folder and its files.
+    std::size_t estimatedMemoryUsage() const;
+
     bool makeDirectory(const char* name, GError** error);
 
     void queryFilesystemInfo();
@@ -74,8 +118,13 @@ public:
 
     bool isEmpty() const;
 
+    // Copies the list of files, filesSnapshot() should be preferred.
     FileInfoList files() const;
 
+    // An immutable snapshot of the files in the folder. It's shared until the content of the
+    // folder changes, so it's cheap to get, and it can be used by any thread without locking.
+    std::shared_ptr<const FileInfoList> filesSnapshot() const;
+
     const FilePath& path() const;
 
     const std::shared_ptr<const FileInfo> &info() const;
@@ -86,10 +135,61 @@ public:
 
     void setCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet);
 
+    // If enabled, local folders are first listed with cheap attributes only (the content type is
+    // guessed from the file name), and the detailed info of the files is then queried by a low
+    // priority background job, which emits filesChanged() for each batch of updated files.
+    static void setDeferContentTest(bool defer);
+
+    static bool deferContentTest() {
+        return deferContentTest_;
+    }
+
+    // If enabled, the content of folders is saved to a persistent snapshot after loading.
+    // reload() shows the content of the snapshot immediately, and then only emits the
+    // differences found by listing the folder.
+    static void setSnapshotCacheEnabled(bool enabled);
+
+    static bool snapshotCacheEnabled() {
+        return snapshotCacheEnabled_;
+    }
+
+    // If enabled, local folders are monitored with inotify directly instead of GFileMonitor.
+    // The watches are shared, and the folder is listed again if the kernel drops events.
+    static void setNativeMonitoringEnabled(bool enabled);
+
+    static bool nativeMonitoringEnabled() {
+        return nativeMonitoringEnabled_;
+    }
+
+    // Remote folders usually cannot be monitored, so the folders without a file monitor are polled.
+    // The modification time of the folder is checked periodically and, if it changed, the folder is
+    // listed again and only the differences are emitted. The interval grows while nothing changes.
+    // An interval of 0 disables polling.
+    static void setPollingInterval(int msec);
+
+    static int pollingInterval() {
+        return pollingInterval_;
+    }
+
+    // The maximum number of folders of the same server which are polled at the same time.
+    static void setMaxPollsPerServer(int maxPolls);
+
+    static int maxPollsPerServer() {
+        return maxPollsPerServer_;
+    }
+
+    // Diagnostics for the handling of file monitor events
+    double changeEventRate() const; // in events per second
+
+    int updateDelay() const; // in milliseconds
+
+    UpdateMode updateMode() const;
+
+    // No lock is held while func is called, so it may use the folder.
     void forEachFile(std::function<void (const std::shared_ptr<const FileInfo>&)> func) const {
-        std::lock_guard<std::mutex> lock{mutex_};
-        for(auto it = files_.begin(); it != files_.end(); ++it) {
-            func(it->second);
+        auto snapshot = filesSnapshot();
+        for(const auto& file: *snapshot) {
+            func(file);
         }
     }
 
@@ -119,17 +219,117 @@ Q_SIGNALS:
     // API handle the error on finish.
     void error(const GErrorPtr& err, Job::ErrorSeverity severity, Job::ErrorAction& response);
 
+protected:
+    void connectNotify(const QMetaMethod& signal) override;
+
 private:
 
+    // An insertion-ordered set of paths with O(1) lookup, insertion and removal,
+    // used to queue the changes reported by the file monitor.
+    class PathQueue {
+    public:
+        typedef std::list<FilePath>::const_iterator const_iterator;
+
+        bool contains(const FilePath& path) const {
+            return index_.find(path) != index_.end();
+        }
+
+        // returns false if the path is already queued
+        bool push(const FilePath& path) {
+            if(contains(path)) {
+                return false;
+            }
+            index_.emplace(path, items_.insert(items_.end(), path));
+            return true;
+        }
+
+        // returns false if the path is not queued
+        bool remove(const FilePath& path) {
+            auto it = index_.find(path);
+            if(it == index_.end()) {
+                return false;
+            }
+            items_.erase(it->second);
+            index_.erase(it);
+            return true;
+        }
+
+        const_iterator erase(const_iterator it) {
+            index_.erase(*it);
+            return items_.erase(it);
+        }
+
+        void clear() {
+            index_.clear();
+            items_.clear();
+        }
+
+        bool empty() const {
+            return items_.empty();
+        }
+
+        std::size_t size() const {
+            return items_.size();
+        }
+
+        const_iterator cbegin() const {
+            return items_.cbegin();
+        }
+
+        const_iterator cend() const {
+            return items_.cend();
+        }
+
+        const_iterator begin() const {
+            return items_.cbegin();
+        }
+
+        const_iterator end() const {
+            return items_.cend();
+        }
+
+    private:
+        std::list<FilePath> items_;
+        std::unordered_map<FilePath, std::list<FilePath>::iterator, FilePathHash> index_;
+    };
+
     static void _onFileChangeEvents(GFileMonitor* monitor, GFile* file, GFile* other_file, GFileMonitorEvent event_type, Folder* _this) {
         _this->onFileChangeEvents(monitor, file, other_file, event_type);
     }
     void onFileChangeEvents(GFileMonitor* monitor, GFile* file, GFile* other_file, GFileMonitorEvent event_type);
     void onDirChanged(GFileMonitorEvent event_type);
+    void onNativeChangeEvents(const std::vector<InotifyEvent>& events);
+    void onNativeMonitorOverflow();
+    void onNativeMonitorRemoved();
 
+    void countChangeEvent();
     void queueUpdate();
     void queueReload();
 
+    // both return true if any change was emitted
+    bool addListedFiles(const FileInfoList& infos);
+    bool finishReconciling();
+    void saveSnapshot();
+    static bool isSameFile(const FileInfo& a, const FileInfo& b);
+
+    static const char* findFilesystemId(const FilePath& path, std::vector<std::shared_ptr<Folder>>& folders);
+    // the filesystem of the folder, used to schedule its jobs
+    const char* ioFilesystemId() const;
+
+    static void retainFolder(const std::shared_ptr<Folder>& folder, std::vector<std::shared_ptr<Folder>>& evicted);
+    static void evictRetainedFolders(std::size_t maxCount, std::size_t maxMemory, std::vector<std::shared_ptr<Folder>>& evicted);
+
+    void queueContentUpgrade();
+    void startNextContentUpgrade();
+
+    bool hasUsers() const;
+    void startPolling();
+    void stopPolling();
+    void schedulePoll(bool changed);
+    void startPollListing();
+    bool acquirePollSlot();
+    void releasePollSlot();
+
     bool eventFileAdded(const FilePath &path);
     bool eventFileChanged(const FilePath &path);
     void eventFileDeleted(const FilePath &path);
@@ -138,14 +338,28 @@ private Q_SLOTS:
 
     void processPendingChanges();
 
+    void onDirListFilesFound(FileInfoList& files);
+
     void onDirListFinished();
 
-    void onFileSystemInfoFinished();
+    void onDirListError(const GErrorPtr& err, Job::ErrorSeverity severity, Job::ErrorAction& response);
+
+    void onFileSystemChanged(const char* filesystemId);
 
     void onFileInfoFinished();
 
+    void onContentUpgradeFinished();
+
+    void onSnapshotLoaded();
+
     void onIdleReload();
 
+    void onPollTimeout();
+
+    void onPollInfoFinished();
+
+    void onPollListFinished();
+
     void onMountAdded(const Mount& mnt);
 
     void onMountRemoved(const Mount& mnt);
@@ -153,38 +367,75 @@ private Q_SLOTS:
 private:
     FilePath dirPath_;
     GFileMonitorPtr dirMonitor_;
+    std::shared_ptr<InotifyWatch> nativeMonitor_; // used instead of dirMonitor_ for local folders
 
     std::shared_ptr<const FileInfo> dirInfo_;
+    const char* ioFilesystemId_; // the filesystem id known before dirInfo_ is loaded
     DirListJob* dirlist_job;
     std::vector<FileInfoJob*> fileinfoJobs_;
-    FileSystemInfoJob* fsInfoJob_;
+
+    /* for deferred content test */
+    FileInfoJob* contentUpgradeJob_;
+    // the files loaded with cheap attributes only, in the order their detailed info is queried
+    std::deque<std::shared_ptr<const FileInfo>> contentUpgradeQueue_;
+    // the files being upgraded by contentUpgradeJob_, by name
+    std::unordered_map<std::string, std::shared_ptr<const FileInfo>> contentUpgradeFiles_;
 
     std::shared_ptr<VolumeManager> volumeManager_;
 
     /* for file monitor */
     bool has_idle_reload_handler;
     bool has_idle_update_handler;
-    FilePathList paths_to_add;
-    FilePathList paths_to_update;
-    FilePathList paths_to_del;
-    FilePathList paths_to_del_later;
+    PathQueue paths_to_add;
+    PathQueue paths_to_update;
+    PathQueue paths_to_del;
+    PathQueue paths_to_del_later;
     // GSList* pending_jobs;
     bool pending_change_notify;
+    bool reloading_on_overflow;
+    // the rate of file monitor events
+    QElapsedTimer eventRateTimer_;
+    unsigned int eventCount_;
+    double eventRate_;
     bool filesystem_info_pending;
 
+    /* for polling the folders without a file monitor */
+    QTimer pollTimer_;
+    int pollInterval_; // the current interval, it grows while nothing changes
+    unsigned int pollsWithoutListing_; // the polls skipped because the folder mtime was unchanged
+    quint64 pollDirMtime_;
+    FileInfoJob* pollInfoJob_;
+    DirListJob* pollListJob_;
+    std::string pollServer_; // the server whose poll slot is held, empty if none
+    bool pollSuspended_; // nobody used the folder when it should have been polled
+
+    // reads the snapshot of the folder in a worker thread, while the folder is listed
+    Job* snapshotLoadJob_;
+    // the files shown before listing the folder (from a snapshot) are being compared with the listing
+    bool reconciling_;
+    // the names of the files found by the listing while reconciling
+    std::unordered_set<std::string> reconciledNames_;
+
     bool wants_incremental;
+    // the folder was loaded by prefetch() and nobody has used it with fromPath() yet
+    bool prefetched_;
+    // the listing of the prefetched folder failed, it's listed again when the folder is used
+    bool prefetchFailed_;
     bool stop_emission; /* don't set it 1 bit to not lock other bits */
 
-    // NOTE: Here, FileInfo::path().baseName().get() should be used as the key value, not FileInfo::name(),
-    // because the latter is not always the same as the former and the former will be used for comparison.
+    // NOTE: Here, FileInfo::baseName() should be used as the key value, not FileInfo::name(),
+    // because the latter is not always the same as the base name of the path and the former will be used for comparison.
     std::unordered_map<const std::string, std::shared_ptr<const FileInfo>, std::hash<std::string>> files_;
+    // files_ is only changed by the main thread, the lock is needed to build the snapshot on other threads
+    mutable std::mutex filesMutex_;
+    // built on demand, and reset after each batch of changes
+    mutable std::shared_ptr<const FileInfoList> filesSnapshot_;
 
-    /* filesystem info - set in query thread, read in main */
-    uint64_t fs_total_size;
-    uint64_t fs_free_size;
-    GCancellablePtr fs_size_cancellable;
+    /* filesystem info, shared by the folders of the same filesystem */
+    std::shared_ptr<FileSystemInfoCache> fsInfoCache_;
+    const char* fsInfoKey_; // the interned filesystem id, or URI of the folder if the id is unknown
+    bool fsInfoWanted_; // the info was requested before the info of the folder was known
 
-    bool has_fs_info : 1;
     bool defer_content_test : 1;
 
     static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> cache_;
@@ -192,6 +443,17 @@ private:
     static QString lastCutFilesDirPath_;
     static std::shared_ptr<const HashSet> cutFilesHashSet_;
     static std::mutex mutex_;
+    // strong references to the recently used folders, the most recently used first
+    static std::list<std::shared_ptr<Folder>> retainedFolders_;
+    static std::size_t maxRetainedFolders_;
+    static std::size_t maxRetainedMemory_;
+    static bool deferContentTest_;
+    static bool snapshotCacheEnabled_;
+    static bool nativeMonitoringEnabled_;
+    static int pollingInterval_;
+    static int maxPollsPerServer_;
+    // the number of folders being polled for each server, only used by the main thread
+    static std::unordered_map<std::string, int> pollsPerServer_;
 };
 
 }
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "folderprefetcher.h"
+#include "folder.h"
+#include <algorithm>
+
+namespace Fm {
+
+std::mutex FolderPrefetcher::mutex_;
+std::weak_ptr<FolderPrefetcher> FolderPrefetcher::globalInstance_;
+bool FolderPrefetcher::enabled_ = false;
+
+FolderPrefetcher::FolderPrefetcher():
+    QObject(),
+    maxFolders_{4},
+    maxMemory_{16 * 1024 * 1024} {
+}
+
+FolderPrefetcher::~FolderPrefetcher() {
+}
+
+// static
+std::shared_ptr<FolderPrefetcher> FolderPrefetcher::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto prefetcher = globalInstance_.lock();
+    if(prefetcher == nullptr) {
+        prefetcher = std::make_shared<FolderPrefetcher>();
+        globalInstance_ = prefetcher;
+    }
+    return prefetcher;
+}
+
+void FolderPrefetcher::setCandidates(const void* source, FilePathList paths) {
+    auto it = std::find_if(candidates_.begin(), candidates_.end(), [source](const std::pair<const void*, FilePathList>& item) {
+        return item.first == source;
+    });
+    if(it != candidates_.end()) {
+        if(it->second == paths) {
+            return;
+        }
+        candidates_.erase(it);
+    }
+    if(!paths.empty()) {
+        // the source which changed most recently is the most relevant one
+        candidates_.emplace(candidates_.begin(), source, std::move(paths));
+    }
+    else if(it == candidates_.end()) {
+        return;
+    }
+    update();
+}
+
+void FolderPrefetcher::removeCandidates(const void* source) {
+    setCandidates(source, FilePathList());
+}
+
+// static
+void FolderPrefetcher::setEnabled(bool enabled) {
+    if(enabled_ != enabled) {
+        enabled_ = enabled;
+        std::shared_ptr<FolderPrefetcher> prefetcher;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            prefetcher = globalInstance_.lock();
+        }
+        if(prefetcher) {
+            prefetcher->update();
+        }
+    }
+}
+
+void FolderPrefetcher::setLimits(std::size_t maxFolders, std::size_t maxMemory) {
+    maxFolders_ = maxFolders;
+    maxMemory_ = maxMemory;
+    update();
+}
+
+std::size_t FolderPrefetcher::prefetchedFolderCount() const {
+    return std::count_if(prefetches_.cbegin(), prefetches_.cend(), [](const Prefetch& prefetch) {
+        return prefetch.folder != nullptr;
+    });
+}
+
+void FolderPrefetcher::update() {
+    // the candidates of all sources by priority, without duplicates
+    FilePathList wanted;
+    if(enabled_) {
+        for(const auto& source: candidates_) {
+            for(const auto& path: source.second) {
+                if(wanted.size() >= maxFolders_) {
+                    break;
+                }
+                if(std::find(wanted.cbegin(), wanted.cend(), path) == wanted.cend()) {
+                    wanted.push_back(path);
+                }
+            }
+        }
+    }
+
+    std::vector<Prefetch> prefetches;
+    prefetches.reserve(wanted.size());
+    for(auto& path: wanted) {
+        auto it = std::find_if(prefetches_.begin(), prefetches_.end(), [&path](const Prefetch& prefetch) {
+            return prefetch.path == path;
+        });
+        if(it != prefetches_.end()) { // already prefetched, or dropped because of the memory budget
+            prefetches.push_back(std::move(*it));
+            prefetches_.erase(it);
+        }
+        else {
+            auto folder = Folder::prefetch(path);
+            // queued, so the folder is never released while it emits the signal
+            connect(folder.get(), &Folder::filesAdded, this, &FolderPrefetcher::checkMemoryBudget, Qt::QueuedConnection);
+            prefetches.push_back(Prefetch{std::move(path), std::move(folder)});
+        }
+    }
+
+    // release the folders which are no longer wanted, this cancels their loading if nobody else uses them
+    for(const auto& prefetch: prefetches_) {
+        if(prefetch.folder) {
+            disconnect(prefetch.folder.get(), nullptr, this, nullptr);
+        }
+    }
+    prefetches_ = std::move(prefetches);
+    checkMemoryBudget();
+}
+
+void FolderPrefetcher::checkMemoryBudget() {
+    std::size_t memory = 0;
+    for(const auto& prefetch: prefetches_) {
+        if(prefetch.folder) {
+            memory += prefetch.folder->estimatedMemoryUsage();
+        }
+    }
+    // drop the folders of the lowest priority first
+    for(auto it = prefetches_.rbegin(); it != prefetches_.rend() && memory > maxMemory_; ++it) {
+        if(it->folder) {
+            memory -= it->folder->estimatedMemoryUsage();
+            disconnect(it->folder.get(), nullptr, this, nullptr);
+            it->folder.reset();
+        }
+    }
+}
+
+} // namespace Fm
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_FOLDER_PREFETCHER_H__
+#define __LIBFM_QT_FM_FOLDER_PREFETCHER_H__
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <mutex>
+
+#include <QObject>
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+
+namespace Fm {
+
+class Folder;
+
+/*
+ * Loads the folders which will probably be opened soon, e.g. the selected or hovered folders
+ * of a view, or the next folder of the browsing history, so they are shown immediately.
+ * The folders are loaded by Folder::prefetch() with background jobs.
+ *
+ * Each source of candidates (a view, a history...) sets its own list, ordered by priority.
+ * The folders which are no longer a candidate of any source are released, which cancels
+ * their listing if nobody else uses them. The number of prefetched folders and their
+ * estimated memory usage are limited, the folders of the lowest priority are dropped first.
+ * Prefetching is disabled by default: listing a folder may mount it (autofs, NFS) or need
+ * round trips to a remote server, which the application should choose to do.
+ * Only the main thread should use the prefetcher.
+ */
+class LIBFM_QT_API FolderPrefetcher: public QObject {
+    Q_OBJECT
+public:
+    explicit FolderPrefetcher();
+
+    ~FolderPrefetcher() override;
+
+    static std::shared_ptr<FolderPrefetcher> globalInstance();
+
+    // Replace the candidates of the source, the most likely ones first.
+    void setCandidates(const void* source, FilePathList paths);
+
+    void removeCandidates(const void* source);
+
+    static bool isEnabled() {
+        return enabled_;
+    }
+
+    // applies to the global instance, even if it's created later
+    static void setEnabled(bool enabled);
+
+    std::size_t maxFolders() const {
+        return maxFolders_;
+    }
+
+    std::size_t maxMemory() const {
+        return maxMemory_;
+    }
+
+    void setLimits(std::size_t maxFolders, std::size_t maxMemory);
+
+    // the folders currently held by the prefetcher
+    std::size_t prefetchedFolderCount() const;
+
+private Q_SLOTS:
+    void checkMemoryBudget();
+
+private:
+    void update();
+
+    struct Prefetch {
+        FilePath path;
+        std::shared_ptr<Folder> folder; // null if it was dropped because of the memory budget
+    };
+
+    // the candidates of each source, the most recently updated source first
+    std::vector<std::pair<const void*, FilePathList>> candidates_;
+    // ordered by priority
+    std::vector<Prefetch> prefetches_;
+    std::size_t maxFolders_;
+    std::size_t maxMemory_;
+
+    static bool enabled_;
+    static std::weak_ptr<FolderPrefetcher> globalInstance_;
+    static std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_FOLDER_PREFETCHER_H__
@@ -0,0 +1,413 @@
+#include "foldersnapshot.h"
+#include "gioptrs.h"
+#include "fileinfoarena.h"
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <QRunnable>
+#include "jobexecutor.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+namespace Fm {
+
+namespace {
+
+const char snapshotMagic[8] = {'L', 'F', 'M', 'Q', 'S', 'N', 'A', 'P'};
+// used to detect snapshots written on machines with a different byte order
+const uint32_t snapshotByteOrder = 0x01020304;
+
+// The snapshots are evicted when they use more disk space than this, the least recently used first.
+// A snapshot is used when it's loaded or saved, which updates its modification time.
+const off_t maxCacheSize = 64 * 1024 * 1024;
+// the snapshots which were not used for this long are evicted (in seconds)
+const time_t maxSnapshotAge = 30 * 24 * 60 * 60;
+// the cache is checked every this number of saved snapshots
+const unsigned int evictionInterval = 16;
+std::atomic<unsigned int> savedSnapshots{0};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileCount;
+};
+
+enum SnapshotFlags {
+    SHORTCUT = 1 << 0,
+    MOUNTABLE = 1 << 1,
+    ACCESSIBLE = 1 << 2,
+    WRITABLE = 1 << 3,
+    DELETABLE = 1 << 4,
+    HIDDEN = 1 << 5,
+    BACKUP = 1 << 6,
+    NAME_CHANGEABLE = 1 << 7,
+    ICON_CHANGEABLE = 1 << 8,
+    HIDDEN_CHANGEABLE = 1 << 9,
+    READ_ONLY = 1 << 10,
+    TRUSTED = 1 << 11
+};
+
+enum SnapshotString {
+    NAME,
+    DISPLAY_NAME,
+    MIME_TYPE,
+    ICON,
+    EMBLEMS, // newline separated
+    TARGET,
+    FILESYSTEM_ID,
+    N_STRINGS
+};
+
+// Each record is followed by its strings (without the terminating nul) and padded to 8 bytes.
+struct SnapshotRecord {
+    uint64_t size;
+    uint64_t inode;
+    uint64_t mtime;
+    uint64_t atime;
+    uint64_t ctime;
+    uint64_t blksize;
+    uint64_t blocks;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t flags;
+    uint32_t stringLengths[N_STRINGS];
+};
+
+inline std::size_t paddedSize(std::size_t size) {
+    return (size + 7) & ~std::size_t(7);
+}
+
+std::string iconToString(const std::shared_ptr<const IconInfo>& icon) {
+    std::string str;
+    if(icon && icon->gicon()) {
+        CStrPtr iconStr{g_icon_to_string(icon->gicon().get())};
+        if(iconStr) {
+            str = iconStr.get();
+        }
+    }
+    return str;
+}
+
+std::shared_ptr<const IconInfo> iconFromString(const std::string& str) {
+    if(!str.empty()) {
+        GIconPtr gicon{g_icon_new_for_string(str.c_str(), nullptr), false};
+        if(gicon) {
+            return IconInfo::fromGIcon(std::move(gicon));
+        }
+    }
+    return nullptr;
+}
+
+class SnapshotWriter: public QRunnable {
+public:
+    SnapshotWriter(std::string fileName, std::shared_ptr<const FileInfoList> files):
+        fileName_{std::move(fileName)},
+        files_{std::move(files)} {
+    }
+
+    void run() override;
+
+private:
+    std::string fileName_;
+    std::shared_ptr<const FileInfoList> files_;
+};
+
+std::string snapshotDir() {
+    CStrPtr dirName{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "snapshots", nullptr)};
+    return dirName.get();
+}
+
+void evictSnapshots() {
+    auto dirName = snapshotDir();
+    GDir* dir = g_dir_open(dirName.c_str(), 0, nullptr);
+    if(!dir) {
+        return;
+    }
+    struct Snapshot {
+        std::string fileName;
+        time_t mtime;
+        off_t size;
+    };
+    std::vector<Snapshot> snapshots;
+    off_t totalSize = 0;
+    const time_t now = time(nullptr);
+    while(const char* name = g_dir_read_name(dir)) {
+        if(!g_str_has_suffix(name, ".snap")) {
+            continue;
+        }
+        CStrPtr fileName{g_build_filename(dirName.c_str(), name, nullptr)};
+        struct stat st;
+        if(stat(fileName.get(), &st) != 0) {
+            continue;
+        }
+        if(now - st.st_mtime > maxSnapshotAge) {
+            g_unlink(fileName.get());
+            continue;
+        }
+        totalSize += st.st_size;
+        snapshots.push_back(Snapshot{fileName.get(), st.st_mtime, st.st_size});
+    }
+    g_dir_close(dir);
+    if(totalSize <= maxCacheSize) {
+        return;
+    }
+    std::sort(snapshots.begin(), snapshots.end(), [](const Snapshot& a, const Snapshot& b) {
+        return a.mtime < b.mtime;
+    });
+    for(const auto& snapshot: snapshots) {
+        if(totalSize <= maxCacheSize) {
+            break;
+        }
+        g_unlink(snapshot.fileName.c_str());
+        totalSize -= snapshot.size;
+    }
+}
+
+} // namespace
+
+// The FileInfo members are accessed directly so that restoring a snapshot does not
+// need to create a GFileInfo for each file.
+class FolderSnapshotAccess {
+public:
+    static void write(const FileInfo& info, std::string& buf);
+    static std::shared_ptr<FileInfo> read(const char*& data, const char* end, const FilePath& dirPath, FileInfoArena& arena);
+};
+
+void FolderSnapshotAccess::write(const FileInfo& info, std::string& buf) {
+    std::string strings[N_STRINGS];
+    strings[NAME] = info.name_;
+    // an empty display name means that it's decoded from the name
+    if(info.hasCustomDispName_) {
+        strings[DISPLAY_NAME] = info.dispName_.value.toStdString();
+    }
+    strings[MIME_TYPE] = info.mimeType_ ? info.mimeType_->name() : "";
+    strings[ICON] = iconToString(info.icon_);
+    for(const auto& emblem: info.emblems_) {
+        if(!strings[EMBLEMS].empty()) {
+            strings[EMBLEMS] += '\n';
+        }
+        strings[EMBLEMS] += iconToString(emblem);
+    }
+    strings[TARGET] = info.target();
+    strings[FILESYSTEM_ID] = info.filesystemId_ ? info.filesystemId_ : "";
+
+    SnapshotRecord record;
+    memset(&record, 0, sizeof(record));
+    record.size = info.size_;
+    record.inode = info.inode_;
+    record.mtime = info.mtime_;
+    record.atime = info.atime_;
+    record.ctime = info.ctime_;
+    record.blksize = info.blksize_;
+    record.blocks = info.blocks_;
+    record.mode = info.mode_;
+    record.uid = info.uid_;
+    record.gid = info.gid_;
+    record.flags = (info.isShortcut_ ? SHORTCUT : 0)
+                   | (info.isMountable_ ? MOUNTABLE : 0)
+                   | (info.isAccessible_ ? ACCESSIBLE : 0)
+                   | (info.isWritable_ ? WRITABLE : 0)
+                   | (info.isDeletable_ ? DELETABLE : 0)
+                   | (info.isHidden_ ? HIDDEN : 0)
+                   | (info.isBackup_ ? BACKUP : 0)
+                   | (info.isNameChangeable_ ? NAME_CHANGEABLE : 0)
+                   | (info.isIconChangeable_ ? ICON_CHANGEABLE : 0)
+                   | (info.isHiddenChangeable_ ? HIDDEN_CHANGEABLE : 0)
+                   | (info.isReadOnly_ ? READ_ONLY : 0)
+                   | (info.isTrustable() ? TRUSTED : 0);
+    std::size_t recordSize = sizeof(record);
+    for(int i = 0; i < N_STRINGS; ++i) {
+        record.stringLengths[i] = strings[i].size();
+        recordSize += strings[i].size();
+    }
+    buf.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    for(int i = 0; i < N_STRINGS; ++i) {
+        buf += strings[i];
+    }
+    buf.append(paddedSize(recordSize) - recordSize, '\0');
+}
+
+std::shared_ptr<FileInfo> FolderSnapshotAccess::read(const char*& data, const char* end, const FilePath& dirPath, FileInfoArena& arena) {
+    SnapshotRecord record;
+    if(std::size_t(end - data) < sizeof(record)) {
+        return nullptr;
+    }
+    memcpy(&record, data, sizeof(record));
+    const char* p = data + sizeof(record);
+    std::string strings[N_STRINGS];
+    for(int i = 0; i < N_STRINGS; ++i) {
+        if(std::size_t(end - p) < record.stringLengths[i]) {
+            return nullptr;
+        }
+        strings[i].assign(p, record.stringLengths[i]);
+        p += record.stringLengths[i];
+    }
+    std::size_t recordSize = p - data;
+    if(std::size_t(end - data) < paddedSize(recordSize) || strings[NAME].empty() || strings[MIME_TYPE].empty()) {
+        return nullptr;
+    }
+    data += paddedSize(recordSize);
+
+    auto info = arena.create();
+    info->dirPath_ = dirPath;
+    info->name_ = std::move(strings[NAME]);
+    if(!strings[DISPLAY_NAME].empty()) {
+        info->setDisplayName(strings[DISPLAY_NAME].c_str());
+    }
+    info->size_ = record.size;
+    info->inode_ = record.inode;
+    info->mtime_ = record.mtime;
+    info->atime_ = record.atime;
+    info->ctime_ = record.ctime;
+    info->blksize_ = record.blksize;
+    info->blocks_ = record.blocks;
+    info->mode_ = record.mode;
+    info->uid_ = record.uid;
+    info->gid_ = record.gid;
+    info->mimeType_ = MimeType::fromName(strings[MIME_TYPE].c_str());
+    info->icon_ = iconFromString(strings[ICON]);
+    if(!info->icon_) {
+        info->icon_ = info->mimeType_->icon();
+    }
+    std::string::size_type start = 0;
+    while(start < strings[EMBLEMS].size()) {
+        auto pos = strings[EMBLEMS].find('\n', start);
+        if(pos == std::string::npos) {
+            pos = strings[EMBLEMS].size();
+        }
+        auto emblem = iconFromString(strings[EMBLEMS].substr(start, pos - start));
+        if(emblem) {
+            info->emblems_.push_front(std::move(emblem));
+        }
+        start = pos + 1;
+    }
+    info->emblems_.reverse();
+    if(!strings[TARGET].empty()) {
+        info->extra().target = std::move(strings[TARGET]);
+    }
+    info->filesystemId_ = strings[FILESYSTEM_ID].empty() ? nullptr : g_intern_string(strings[FILESYSTEM_ID].c_str());
+    info->isShortcut_ = (record.flags & SHORTCUT) != 0;
+    info->isMountable_ = (record.flags & MOUNTABLE) != 0;
+    info->isAccessible_ = (record.flags & ACCESSIBLE) != 0;
+    info->isWritable_ = (record.flags & WRITABLE) != 0;
+    info->isDeletable_ = (record.flags & DELETABLE) != 0;
+    info->isHidden_ = (record.flags & HIDDEN) != 0;
+    info->isBackup_ = (record.flags & BACKUP) != 0;
+    info->isNameChangeable_ = (record.flags & NAME_CHANGEABLE) != 0;
+    info->isIconChangeable_ = (record.flags & ICON_CHANGEABLE) != 0;
+    info->isHiddenChangeable_ = (record.flags & HIDDEN_CHANGEABLE) != 0;
+    info->isReadOnly_ = (record.flags & READ_ONLY) != 0;
+    info->isTrusted_ = (record.flags & TRUSTED) != 0;
+    return info;
+}
+
+void SnapshotWriter::run() {
+    std::string buf;
+    SnapshotHeader header;
+    memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = FolderSnapshot::formatVersion;
+    header.byteOrder = snapshotByteOrder;
+    header.fileCount = files_->size();
+    buf.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const auto& file: *files_) {
+        FolderSnapshotAccess::write(*file, buf);
+    }
+
+    CStrPtr dirName{g_path_get_dirname(fileName_.c_str())};
+    g_mkdir_with_parents(dirName.get(), 0700);
+    // g_file_set_contents() writes to a temporary file first, so readers never see a partial snapshot
+    GErrorPtr err;
+    if(!g_file_set_contents(fileName_.c_str(), buf.data(), buf.size(), &err)) {
+        qDebug("failed to write folder snapshot: %s", err->message);
+    }
+    if(savedSnapshots++ % evictionInterval == 0) {
+        evictSnapshots();
+    }
+}
+
+// static
+std::string FolderSnapshot::snapshotFile(const FilePath& dirPath) {
+    auto uri = dirPath.uri();
+    CStrPtr hash{g_compute_checksum_for_string(G_CHECKSUM_MD5, uri.get(), -1)};
+    CStrPtr fileName{g_build_filename(snapshotDir().c_str(), hash.get(), nullptr)};
+    return std::string{fileName.get()} + ".snap";
+}
+
+// static
+bool FolderSnapshot::load(const FilePath& dirPath, FileInfoList& files, const std::shared_ptr<const HashSet>& cutFilesHashSet) {
+    auto fileName = snapshotFile(dirPath);
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    const std::size_t size = st.st_size;
+    // the least recently used snapshots are evicted first
+    futimens(fd, nullptr);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        return false;
+    }
+
+    bool valid = false;
+    const char* data = static_cast<const char*>(map);
+    const char* end = data + size;
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, snapshotMagic, sizeof(header.magic)) == 0
+            && header.version == formatVersion
+            && header.byteOrder == snapshotByteOrder) {
+        data += sizeof(header);
+        FileInfoList result;
+        FileInfoArena arena{header.fileCount};
+        // every record takes at least sizeof(SnapshotRecord) bytes
+        result.reserve(std::min<uint64_t>(header.fileCount, size / sizeof(SnapshotRecord)));
+        for(uint64_t i = 0; i < header.fileCount; ++i) {
+            auto info = FolderSnapshotAccess::read(data, end, dirPath, arena);
+            if(!info) {
+                break;
+            }
+            if(cutFilesHashSet
+                    && cutFilesHashSet->count(info->pathHash()) > 0) {
+                info->bindCutFiles(cutFilesHashSet);
+            }
+            result.push_back(std::move(info));
+        }
+        if(result.size() == header.fileCount) {
+            files = std::move(result);
+            valid = true;
+        }
+    }
+    munmap(map, size);
+
+    if(!valid) { // the snapshot is corrupted or outdated
+        g_unlink(fileName.c_str());
+    }
+    return valid;
+}
+
+// static
+void FolderSnapshot::save(const FilePath& dirPath, std::shared_ptr<const FileInfoList> files) {
+    JobExecutor::start(new SnapshotWriter{snapshotFile(dirPath), std::move(files)}, JobExecutor::Pool::BULK_IO, QThread::LowPriority);
+}
+
+// static
+void FolderSnapshot::remove(const FilePath& dirPath) {
+    g_unlink(snapshotFile(dirPath).c_str());
+}
+
+} // namespace Fm
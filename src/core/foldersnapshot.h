@@ -0,0 +1,37 @@
+#ifndef FM2_FOLDERSNAPSHOT_H
+#define FM2_FOLDERSNAPSHOT_H
+
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+#include "fileinfo.h"
+
+#include <string>
+
+namespace Fm {
+
+// Persistent snapshots of folder contents stored under $XDG_CACHE_HOME/libfm-qt/snapshots/.
+// A snapshot is only used to show the content of a folder immediately. It can be outdated
+// at any time, so it should always be reconciled with a real listing of the folder.
+// The snapshots not used for 30 days are evicted, and so are the least recently used ones
+// when all of them use more than 64 MiB.
+class FolderSnapshot {
+public:
+    // Read the snapshot of the folder (memory-mapped), returns false if there is no valid snapshot.
+    // The info of every file is built, so it should be called in a worker thread.
+    static bool load(const FilePath& dirPath, FileInfoList& files, const std::shared_ptr<const HashSet>& cutFilesHashSet = nullptr);
+
+    // Write the snapshot of the folder asynchronously.
+    static void save(const FilePath& dirPath, std::shared_ptr<const FileInfoList> files);
+
+    // Remove the snapshot of a folder which does not exist anymore.
+    static void remove(const FilePath& dirPath);
+
+    static std::string snapshotFile(const FilePath& dirPath);
+
+    // the snapshot files are only valid for the same format version
+    static constexpr unsigned int formatVersion = 2;
+};
+
+} // namespace Fm
+
+#endif // FM2_FOLDERSNAPSHOT_H
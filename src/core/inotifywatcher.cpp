@@ -0,0 +1,250 @@
+#include "inotifywatcher.h"
+#include <QSocketNotifier>
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace Fm {
+
+std::mutex InotifyWatcher::mutex_;
+std::weak_ptr<InotifyWatcher> InotifyWatcher::globalInstance_;
+
+#ifdef __linux__
+// the events needed by Folder, which are close to what GFileMonitor reports
+static const uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                  | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+                                  | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+static bool translateEvent(const struct inotify_event* event, GFileMonitorEvent& type) {
+    if(event->mask & IN_UNMOUNT) {
+        type = G_FILE_MONITOR_EVENT_UNMOUNTED;
+    }
+    else if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        type = G_FILE_MONITOR_EVENT_CREATED;
+    }
+    else if(event->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        type = G_FILE_MONITOR_EVENT_DELETED;
+    }
+    else if(event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+        type = G_FILE_MONITOR_EVENT_CHANGED;
+    }
+    else if(event->mask & IN_ATTRIB) {
+        type = G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+#endif
+
+InotifyWatch::InotifyWatch(std::shared_ptr<InotifyWatcher> watcher, int wd, EventsCallback onEvents, OverflowCallback onOverflow,
+                           RemovedCallback onRemoved):
+    watcher_{std::move(watcher)},
+    wd_{wd},
+    onEvents_{std::move(onEvents)},
+    onOverflow_{std::move(onOverflow)},
+    onRemoved_{std::move(onRemoved)} {
+}
+
+InotifyWatch::~InotifyWatch() {
+    watcher_->removeWatch(this);
+}
+
+
+InotifyWatcher::InotifyWatcher():
+    QObject(),
+    fd_{-1},
+    notifier_{nullptr} {
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd_ >= 0) {
+        notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+        connect(notifier_, &QSocketNotifier::activated, this, &InotifyWatcher::onReadyRead);
+    }
+    else {
+        qDebug("inotify cannot be used: %s", g_strerror(errno));
+    }
+#endif
+}
+
+InotifyWatcher::~InotifyWatcher() {
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+// static
+std::shared_ptr<InotifyWatcher> InotifyWatcher::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto watcher = globalInstance_.lock();
+    if(watcher == nullptr) {
+        // the last watch may be removed while the events are dispatched by the watcher itself
+        watcher = std::shared_ptr<InotifyWatcher>{new InotifyWatcher(), [](InotifyWatcher* w) {
+            w->deleteLater();
+        }};
+        globalInstance_ = watcher;
+    }
+    return watcher;
+}
+
+std::shared_ptr<InotifyWatch> InotifyWatcher::addWatch(const FilePath& dirPath, InotifyWatch::EventsCallback onEvents,
+                                                       InotifyWatch::OverflowCallback onOverflow,
+                                                       InotifyWatch::RemovedCallback onRemoved) {
+#ifdef __linux__
+    if(fd_ < 0 || !dirPath.isNative()) {
+        return nullptr;
+    }
+    auto localPath = dirPath.localPath();
+    int wd = inotify_add_watch(fd_, localPath.get(), watchMask);
+    if(wd < 0) {
+        // ENOSPC: the limit of inotify watches (fs.inotify.max_user_watches) is reached
+        qDebug("inotify cannot watch %s: %s", localPath.get(), g_strerror(errno));
+        return nullptr;
+    }
+    std::shared_ptr<InotifyWatch> watch{new InotifyWatch{globalInstance(), wd, std::move(onEvents), std::move(onOverflow),
+                                                         std::move(onRemoved)}};
+    watches_[wd].push_back(watch.get());
+    return watch;
+#else
+    Q_UNUSED(dirPath);
+    Q_UNUSED(onEvents);
+    Q_UNUSED(onOverflow);
+    Q_UNUSED(onRemoved);
+    return nullptr;
+#endif
+}
+
+void InotifyWatcher::removeWatch(InotifyWatch* watch) {
+    if(!watch->isValid()) { // the kernel removed the watch already
+        removedWatches_.erase(std::remove(removedWatches_.begin(), removedWatches_.end(), watch), removedWatches_.end());
+        return;
+    }
+    auto it = watches_.find(watch->wd_);
+    if(it == watches_.end()) {
+        return;
+    }
+    auto& users = it->second;
+    users.erase(std::remove(users.begin(), users.end(), watch), users.end());
+#ifdef __linux__
+    if(users.empty()) { // the last user of the watch descriptor
+        inotify_rm_watch(fd_, it->first);
+        watches_.erase(it);
+    }
+#endif
+}
+
+void InotifyWatcher::dispatch(int wd, const std::vector<InotifyEvent>& events) {
+    auto it = watches_.find(wd);
+    if(it == watches_.end()) {
+        return;
+    }
+    // the callbacks may add or remove watches
+    const auto users = it->second;
+    for(auto watch: users) {
+        auto current = watches_.find(wd);
+        if(current == watches_.end()) {
+            break;
+        }
+        if(std::find(current->second.cbegin(), current->second.cend(), watch) != current->second.cend()) {
+            watch->onEvents_(events);
+        }
+    }
+}
+
+void InotifyWatcher::dispatchOverflow() {
+    std::vector<InotifyWatch*> users;
+    for(const auto& item: watches_) {
+        users.insert(users.end(), item.second.cbegin(), item.second.cend());
+    }
+    for(auto watch: users) {
+        auto it = watches_.find(watch->wd_);
+        if(it != watches_.end() && std::find(it->second.cbegin(), it->second.cend(), watch) != it->second.cend()) {
+            watch->onOverflow_();
+        }
+    }
+}
+
+void InotifyWatcher::dispatchRemoved(int wd) {
+    auto it = watches_.find(wd);
+    if(it == watches_.end()) { // removed by inotify_rm_watch()
+        return;
+    }
+    // the watch descriptor is invalid now and may be reused by the kernel for another folder
+    const auto users = std::move(it->second);
+    watches_.erase(it);
+    for(auto watch: users) {
+        watch->wd_ = -1;
+    }
+    removedWatches_.insert(removedWatches_.end(), users.cbegin(), users.cend());
+    // the callbacks may destroy the watches
+    for(auto watch: users) {
+        if(std::find(removedWatches_.cbegin(), removedWatches_.cend(), watch) != removedWatches_.cend()) {
+            watch->onRemoved_();
+        }
+    }
+}
+
+void InotifyWatcher::onReadyRead() {
+#ifdef __linux__
+    bool overflow = false;
+    std::vector<int> removedWds;
+    // consecutive events of the same folder are dispatched together
+    int batchWd = -1;
+    std::vector<InotifyEvent> batch;
+    std::vector<std::pair<int, std::vector<InotifyEvent>>> batches;
+    alignas(struct inotify_event) char buf[64 * 1024];
+    for(;;) {
+        ssize_t len = read(fd_, buf, sizeof(buf));
+        if(len <= 0) { // EAGAIN: no more events for now
+            break;
+        }
+        for(char* p = buf; p < buf + len;) {
+            auto event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if(event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if(event->mask & IN_IGNORED) { // the watch was removed, e.g. the folder was deleted
+                removedWds.push_back(event->wd);
+                continue;
+            }
+            GFileMonitorEvent type;
+            if(!translateEvent(event, type)) {
+                continue;
+            }
+            if(event->wd != batchWd && !batch.empty()) {
+                batches.emplace_back(batchWd, std::move(batch));
+                batch.clear();
+            }
+            batchWd = event->wd;
+            batch.push_back(InotifyEvent{type, event->len > 0 ? std::string{event->name} : std::string{}});
+        }
+    }
+    if(!batch.empty()) {
+        batches.emplace_back(batchWd, std::move(batch));
+    }
+
+    // NOTE: the watcher is deleted later if the callbacks remove the last watch, so it's still valid here
+    if(overflow) {
+        // the events are incomplete, the users should read the folders again instead
+        dispatchOverflow();
+    }
+    else {
+        for(const auto& item: batches) {
+            dispatch(item.first, item.second);
+        }
+    }
+    for(int wd: removedWds) {
+        dispatchRemoved(wd);
+    }
+#endif
+}
+
+} // namespace Fm
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_INOTIFY_WATCHER_H__
+#define __LIBFM_QT_FM_INOTIFY_WATCHER_H__
+
+#include <QObject>
+#include <gio/gio.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "../libfmqtglobals.h"
+#include "filepath.h"
+
+class QSocketNotifier;
+
+namespace Fm {
+
+// A change reported for a watched folder, an empty name means the folder itself.
+struct InotifyEvent {
+    GFileMonitorEvent type;
+    std::string name;
+};
+
+class InotifyWatcher;
+
+// A watch on a local folder, the folder is watched as long as this object exists.
+class LIBFM_QT_API InotifyWatch {
+public:
+    // called in the main thread with all the events of the folder read at once
+    typedef std::function<void (const std::vector<InotifyEvent>& events)> EventsCallback;
+    // called when events were lost because the queue of the kernel overflowed
+    typedef std::function<void ()> OverflowCallback;
+    // called when the kernel removed the watch (e.g. the folder was deleted or unmounted),
+    // no event is reported for the folder anymore
+    typedef std::function<void ()> RemovedCallback;
+
+    ~InotifyWatch();
+
+    bool isValid() const {
+        return wd_ >= 0;
+    }
+
+private:
+    friend class InotifyWatcher;
+
+    InotifyWatch(std::shared_ptr<InotifyWatcher> watcher, int wd, EventsCallback onEvents, OverflowCallback onOverflow,
+                 RemovedCallback onRemoved);
+
+    std::shared_ptr<InotifyWatcher> watcher_;
+    int wd_; // -1 once the kernel removed the watch
+    EventsCallback onEvents_;
+    OverflowCallback onOverflow_;
+    RemovedCallback onRemoved_;
+};
+
+/*
+ * Monitors local folders with inotify directly, instead of a GFileMonitor for each folder.
+ * All watches share a single inotify instance, and the events are read in batches in the main
+ * thread. The kernel returns the same watch for the same folder, so all the users of a folder
+ * (even through different paths) share it, which saves the limited inotify watches.
+ * Unlike GFileMonitor, the overflow of the kernel queue is reported, so the users can resync.
+ * This is only available on Linux, addWatch() returns nullptr if it cannot be used.
+ */
+class LIBFM_QT_API InotifyWatcher: public QObject {
+    Q_OBJECT
+public:
+    explicit InotifyWatcher();
+
+    ~InotifyWatcher() override;
+
+    static std::shared_ptr<InotifyWatcher> globalInstance();
+
+    // returns nullptr if the folder cannot be watched (e.g. the limit of inotify watches is reached)
+    std::shared_ptr<InotifyWatch> addWatch(const FilePath& dirPath, InotifyWatch::EventsCallback onEvents,
+                                           InotifyWatch::OverflowCallback onOverflow,
+                                           InotifyWatch::RemovedCallback onRemoved);
+
+    bool isValid() const {
+        return fd_ >= 0;
+    }
+
+private Q_SLOTS:
+    void onReadyRead();
+
+private:
+    friend class InotifyWatch;
+
+    void removeWatch(InotifyWatch* watch);
+
+    void dispatch(int wd, const std::vector<InotifyEvent>& events);
+
+    void dispatchOverflow();
+
+    void dispatchRemoved(int wd);
+
+    int fd_;
+    QSocketNotifier* notifier_;
+    // the users of each inotify watch descriptor
+    std::unordered_map<int, std::vector<InotifyWatch*>> watches_;
+    // the watches removed by the kernel, which are not destroyed by their users yet
+    std::vector<InotifyWatch*> removedWatches_;
+
+    static std::mutex mutex_;
+    static std::weak_ptr<InotifyWatcher> globalInstance_;
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_INOTIFY_WATCHER_H__
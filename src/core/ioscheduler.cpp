@@ -0,0 +1,270 @@
+#include "ioscheduler.h"
+#include "job.h"
+#include "job_p.h"
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+namespace Fm {
+
+namespace {
+
+struct Lane {
+    int runningJobs = 0;
+    // the running jobs which answered the user and wait to take their slot back
+    int resumingJobs = 0;
+    // the jobs waiting for a free slot, in submission order
+    std::vector<JobRunner*> waitingJobs;
+};
+
+struct DeviceState {
+    int maxJobs = 0;
+    // the metadata jobs (listings, file info) and the bulk jobs (copies, size counting,
+    // thumbnails) have their own slots, so bulk jobs cannot delay the metadata jobs
+    Lane lanes[2];
+};
+
+std::mutex mutex_;
+// notified when a slot is freed, or a job waiting to resume is cancelled
+std::condition_variable slotFreed_;
+// the keys are interned strings, so comparing the pointers is enough
+std::unordered_map<const char*, DeviceState> devices_;
+int maxJobsPerDevice_ = 0;
+// returns 1 for rotational disks, 0 for others, and -1 if unknown
+int isRotational(const char* filesystemId) {
+#ifdef __linux__
+    guint64 dev;
+    // local filesystem ids from GIO are "l" followed by st_dev
+    if(sscanf(filesystemId, "l%" G_GUINT64_FORMAT, &dev) != 1) {
+        return -1;
+    }
+    const unsigned int devMajor = major(dev), devMinor = minor(dev);
+    // partitions do not have their own queue, the disk containing them has
+    const char* const formats[] = {"/sys/dev/block/%u:%u/queue/rotational", "/sys/dev/block/%u:%u/../queue/rotational"};
+    for(auto format: formats) {
+        char fileName[128];
+        snprintf(fileName, sizeof(fileName), format, devMajor, devMinor);
+        if(FILE* file = fopen(fileName, "r")) {
+            int value = -1;
+            if(fscanf(file, "%d", &value) != 1) {
+                value = -1;
+            }
+            fclose(file);
+            if(value >= 0) {
+                return value != 0 ? 1 : 0;
+            }
+        }
+    }
+#else
+    Q_UNUSED(filesystemId);
+#endif
+    return -1;
+}
+
+int defaultMaxJobs(const char* filesystemId) {
+    if(filesystemId[0] != 'l') { // remote filesystems
+        return 4;
+    }
+    return isRotational(filesystemId) == 1 ? 2 : 8;
+}
+
+DeviceState& deviceState(const char* filesystemId) {
+    auto& device = devices_[filesystemId];
+    if(device.maxJobs == 0) {
+        device.maxJobs = defaultMaxJobs(filesystemId);
+    }
+    return device;
+}
+
+Lane& laneOf(DeviceState& device, const JobRunner* runner) {
+    return device.lanes[runner->isBulk() ? 1 : 0];
+}
+
+bool hasFreeSlot(const DeviceState& device, const Lane& lane) {
+    return lane.runningJobs < (maxJobsPerDevice_ > 0 ? maxJobsPerDevice_ : device.maxJobs);
+}
+
+// Take the next job to start: interactive jobs first, then by priority, then in submission order.
+// The runner returned holds a slot of the device.
+JobRunner* takeWaitingJob(DeviceState& device, Lane& lane) {
+    // the resuming jobs get the free slots first
+    if(lane.waitingJobs.empty() || lane.resumingJobs > 0 || !hasFreeSlot(device, lane)) {
+        return nullptr;
+    }
+    auto best = lane.waitingJobs.begin();
+    for(auto it = best + 1; it != lane.waitingJobs.end(); ++it) {
+        if((*it)->isInteractive() != (*best)->isInteractive()
+                ? (*it)->isInteractive()
+                : (*it)->queuePriority() > (*best)->queuePriority()) {
+            best = it;
+        }
+    }
+    JobRunner* runner = *best;
+    lane.waitingJobs.erase(best);
+    ++lane.runningJobs;
+    return runner;
+}
+
+} // namespace
+
+// static
+void IOScheduler::schedule(JobRunner* runner) {
+    const char* filesystemId = runner->filesystemId();
+    if(filesystemId) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        // a cancelled job finishes immediately without a slot. This is checked with the lock
+        // held so a job cancelled after being queued is always found by startCancelledJob().
+        if(runner->job()->isCancelled()) {
+            runner->setFilesystemId(nullptr);
+            runner->start();
+            return;
+        }
+        auto& device = deviceState(filesystemId);
+        auto& lane = laneOf(device, runner);
+        if(!lane.waitingJobs.empty() || lane.resumingJobs > 0 || !hasFreeSlot(device, lane)) {
+            lane.waitingJobs.push_back(runner);
+            return;
+        }
+        ++lane.runningJobs;
+    }
+    runner->start();
+}
+
+// static
+void IOScheduler::releaseDevice(JobRunner* runner) {
+    JobRunner* next;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto& device = deviceState(runner->filesystemId());
+        auto& lane = laneOf(device, runner);
+        --lane.runningJobs;
+        next = takeWaitingJob(device, lane);
+        if(lane.resumingJobs > 0) {
+            slotFreed_.notify_all();
+        }
+    }
+    if(next) {
+        next->start();
+    }
+}
+
+// static
+void IOScheduler::suspendCurrentJob() {
+    JobRunner* runner = JobRunner::current();
+    if(runner == nullptr || runner->filesystemId() == nullptr) { // no slot is held
+        return;
+    }
+    runner->setSuspendedFilesystemId(runner->filesystemId());
+    releaseDevice(runner);
+    runner->setFilesystemId(nullptr);
+}
+
+// static
+void IOScheduler::resumeCurrentJob() {
+    JobRunner* runner = JobRunner::current();
+    if(runner == nullptr || runner->suspendedFilesystemId() == nullptr) {
+        return;
+    }
+    const char* filesystemId = runner->suspendedFilesystemId();
+    runner->setSuspendedFilesystemId(nullptr);
+    std::unique_lock<std::mutex> lock{mutex_};
+    auto& device = deviceState(filesystemId);
+    auto& lane = laneOf(device, runner);
+    // a cancelled job finishes without a slot
+    auto canResume = [&]() {
+        return runner->job()->isCancelled() || hasFreeSlot(device, lane);
+    };
+    if(!canResume()) {
+        ++lane.resumingJobs;
+        slotFreed_.wait(lock, canResume);
+        --lane.resumingJobs;
+    }
+    if(!runner->job()->isCancelled()) {
+        ++lane.runningJobs;
+        runner->setFilesystemId(filesystemId);
+    }
+    // the waiting jobs were held back while this job was resuming
+    std::vector<JobRunner*> runners;
+    while(JobRunner* next = takeWaitingJob(device, lane)) {
+        runners.push_back(next);
+    }
+    lock.unlock();
+    for(auto next: runners) {
+        next->start();
+    }
+}
+
+// static
+void IOScheduler::startCancelledJob(const Job* job) {
+    JobRunner* runner = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        // a job waiting to resume stops waiting
+        slotFreed_.notify_all();
+        for(auto& item: devices_) {
+            for(auto& lane: item.second.lanes) {
+                auto& waitingJobs = lane.waitingJobs;
+                auto it = std::find_if(waitingJobs.begin(), waitingJobs.end(), [job](JobRunner* waiting) {
+                    return waiting->job() == job;
+                });
+                if(it != waitingJobs.end()) {
+                    runner = *it;
+                    waitingJobs.erase(it);
+                    break;
+                }
+            }
+            if(runner) {
+                break;
+            }
+        }
+    }
+    if(runner) {
+        // it does not hold a slot of the device
+        runner->setFilesystemId(nullptr);
+        runner->start();
+    }
+}
+
+// static
+void IOScheduler::startWaitingJobs() {
+    std::vector<JobRunner*> runners;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for(auto& item: devices_) {
+            for(auto& lane: item.second.lanes) {
+                while(JobRunner* runner = takeWaitingJob(item.second, lane)) {
+                    runners.push_back(runner);
+                }
+            }
+        }
+        slotFreed_.notify_all();
+    }
+    for(auto runner: runners) {
+        runner->start();
+    }
+}
+
+// static
+void IOScheduler::setMaxJobsPerDevice(int maxJobs) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        maxJobsPerDevice_ = maxJobs;
+    }
+    // the devices may have more free slots now
+    startWaitingJobs();
+}
+
+// static
+int IOScheduler::maxJobsPerDevice() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxJobsPerDevice_;
+}
+
+} // namespace Fm
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_IO_SCHEDULER_H__
+#define __LIBFM_QT_FM_IO_SCHEDULER_H__
+
+#include "../libfmqtglobals.h"
+
+namespace Fm {
+
+class Job;
+class JobRunner;
+
+/*
+ * Limits the number of jobs working on the same device at the same time, so that
+ * concurrent jobs do not make a disk seek back and forth. Devices are identified by
+ * their filesystem id (the "id::filesystem" attribute of GIO, see FileInfo::filesystemId()),
+ * which is given to the jobs by their callers with Job::setIOFilesystemId().
+ * The jobs submitted to JobExecutor for a busy device wait in a queue of the device
+ * without taking a thread of the pool, so they don't delay the jobs of other devices.
+ * The jobs of the METADATA_IO pool and the other (bulk) jobs have separate slots, so
+ * long copies, size counting or thumbnails never hold back folder listings.
+ * When a device is busy, the waiting interactive jobs are started before the background ones.
+ */
+class LIBFM_QT_API IOScheduler {
+public:
+    // Use the same limit for all devices. 0 (the default) means automatic:
+    // 2 jobs for rotational disks, 4 for remote filesystems and 8 for others.
+    // The limit applies to the metadata jobs and the bulk jobs separately.
+    static void setMaxJobsPerDevice(int maxJobs);
+
+    static int maxJobsPerDevice();
+
+    // Called by a job running in JobExecutor before it waits for the user (e.g. an error
+    // dialog), so its slot is given to the other jobs meanwhile.
+    static void suspendCurrentJob();
+
+    // Called when the user answered, takes a slot of the device again (waiting for one if needed).
+    static void resumeCurrentJob();
+
+private:
+    // Start the runner in its pool if its device has a free slot, otherwise queue it.
+    static void schedule(JobRunner* runner);
+
+    // Release the slot held by the runner, and start the next job waiting for the device.
+    static void releaseDevice(JobRunner* runner);
+
+    // Start a cancelled job which is still waiting for its device, so it finishes immediately.
+    static void startCancelledJob(const Job* job);
+
+    static void startWaitingJobs();
+
+    friend class Job;
+    friend class JobRunner;
+    friend class JobExecutor;
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_IO_SCHEDULER_H__
@@ -3,8 +3,12 @@
 
 namespace Fm {
 
+thread_local JobRunner* JobRunner::current_ = nullptr;
+
 Job::Job():
     paused_{false},
+    interactive_{false},
+    ioFilesystemId_{nullptr},
     cancellable_{g_cancellable_new(), false},
     cancellableHandler_{g_signal_connect(cancellable_.get(), "cancelled", G_CALLBACK(_onCancellableCancelled), this)} {
 }
@@ -16,12 +20,7 @@ Job::~Job() {
 }
 
 void Job::runAsync(QThread::Priority priority) {
-    auto thread = new JobThread(this);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    if(autoDelete()) {
-        connect(this, &Job::finished, this, &Job::deleteLater);
-    }
-    thread->start(priority);
+    JobExecutor::submit(this, executorPool(), priority);
 }
 
 void Job::cancel() {
@@ -33,6 +32,12 @@ void Job::run() {
     Q_EMIT finished();
 }
 
+void Job::onCancellableCancelled(GCancellable* /*cancellable*/) {
+    // a job waiting for its device should finish immediately
+    IOScheduler::startCancelledJob(this);
+    Q_EMIT cancelled();
+}
+
 
 Job::ErrorAction Job::emitError(const GErrorPtr &err, Job::ErrorSeverity severity) {
     ErrorAction response = ErrorAction::CONTINUE;
@@ -40,7 +45,10 @@ Job::ErrorAction Job::emitError(const GErrorPtr &err, Job::ErrorSeverity severit
     if(err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_FAILED_HANDLED) {
         return response;
     }
+    // the device is not kept busy while the user decides what to do
+    IOScheduler::suspendCurrentJob();
     Q_EMIT error(err, severity, response);
+    IOScheduler::resumeCurrentJob();
 
     if(severity == ErrorSeverity::CRITICAL || response == ErrorAction::ABORT) {
         cancel();
@@ -28,6 +28,7 @@
 #include <gio/gio.h>
 #include "gobjectptr.h"
 #include "gioptrs.h"
+#include "jobexecutor.h"
 #include "../libfmqtglobals.h"
 
 
@@ -36,7 +37,7 @@ namespace Fm {
 /*
  * Fm::Job can be used in several different modes.
  * 1. run with QThreadPool::start()
- * 2. call runAsync(), which will create a new QThread and move the object to the thread.
+ * 2. call runAsync(), which queues the job in the thread pool of JobExecutor returned by executorPool().
  * 3. create a new QThread, and connect the started() signal to the slot Job::run()
  * 4. Directly call Job::run(), which executes synchrounously as a normal blocking call
 */
@@ -70,6 +71,33 @@ public:
 
     void runAsync(QThread::Priority priority = QThread::InheritPriority);
 
+    // the pool of JobExecutor used by runAsync()
+    virtual JobExecutor::Pool executorPool() const {
+        return JobExecutor::Pool::METADATA_IO;
+    }
+
+    // Interactive jobs work for what the user is looking at, e.g. listing the current folder.
+    // They are started before the background jobs waiting for the same device or pool.
+    void setInteractive(bool interactive) {
+        interactive_ = interactive;
+    }
+
+    bool isInteractive() const {
+        return interactive_;
+    }
+
+    // The interned id of the filesystem the job mostly works on (see FileInfo::filesystemId()),
+    // used by IOScheduler to limit the concurrent jobs per device. It should be set before
+    // runAsync() by the caller, which usually knows it already, so no I/O is needed to find it.
+    // If it's nullptr (the default), the job is not limited.
+    void setIOFilesystemId(const char* filesystemId) {
+        ioFilesystemId_ = filesystemId;
+    }
+
+    const char* ioFilesystemId() const {
+        return ioFilesystemId_;
+    }
+
     bool pause();
 
     void resume();
@@ -103,12 +131,12 @@ private:
         _this->onCancellableCancelled(cancellable);
     }
 
-    void onCancellableCancelled(GCancellable* /*cancellable*/) {
-        Q_EMIT cancelled();
-    }
+    void onCancellableCancelled(GCancellable* cancellable);
 
 private:
     bool paused_;
+    bool interactive_;
+    const char* ioFilesystemId_;
     GCancellablePtr cancellable_;
     gulong cancellableHandler_;
 };
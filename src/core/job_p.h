@@ -1,24 +1,105 @@
 #ifndef JOB_P_H
 #define JOB_P_H
 
+#include <QRunnable>
 #include <QThread>
+#include <QThreadPool>
 #include "job.h"
+#include "ioscheduler.h"
 
 namespace Fm {
 
-class JobThread: public QThread {
-    Q_OBJECT
+// Runs a job in a thread pool without letting the pool delete it, since
+// the job is a QObject which should be deleted with deleteLater().
+class JobRunner: public QRunnable {
 public:
-    JobThread(Job* job): job_{job} {
+    JobRunner(Job* job, QThreadPool* pool, QThread::Priority priority, int queuePriority, bool bulk):
+        job_{job},
+        pool_{pool},
+        priority_{priority},
+        queuePriority_{queuePriority},
+        filesystemId_{job->ioFilesystemId()},
+        suspendedFilesystemId_{nullptr},
+        interactive_{job->isInteractive()},
+        bulk_{bulk} {
+        setAutoDelete(true);
     }
 
-protected:
+    // queue the runner in its pool, it's deleted after running
+    void start() {
+        pool_->start(this, queuePriority_);
+    }
 
     void run() override {
+        // the threads of the pool are reused, so restore their priority afterwards
+        auto thread = QThread::currentThread();
+        auto oldPriority = thread->priority();
+        if(priority_ != QThread::InheritPriority) {
+            thread->setPriority(priority_);
+        }
+        current_ = this;
         job_->run();
+        current_ = nullptr;
+        if(priority_ != QThread::InheritPriority) {
+            thread->setPriority(oldPriority);
+        }
+        // NOTE: the job may be deleted already
+        if(filesystemId_) {
+            IOScheduler::releaseDevice(this);
+        }
+    }
+
+    // the runner of the job running in the current thread, nullptr if none
+    static JobRunner* current() {
+        return current_;
+    }
+
+    Job* job() const {
+        return job_;
+    }
+
+    int queuePriority() const {
+        return queuePriority_;
+    }
+
+    bool isInteractive() const {
+        return interactive_;
+    }
+
+    // bulk jobs do not use the slots of the metadata jobs
+    bool isBulk() const {
+        return bulk_;
+    }
+
+    // the device whose slot is held by the running job, nullptr if none
+    const char* filesystemId() const {
+        return filesystemId_;
+    }
+
+    void setFilesystemId(const char* filesystemId) {
+        filesystemId_ = filesystemId;
     }
 
+    // the device whose slot was released while the job waits for the user
+    const char* suspendedFilesystemId() const {
+        return suspendedFilesystemId_;
+    }
+
+    void setSuspendedFilesystemId(const char* filesystemId) {
+        suspendedFilesystemId_ = filesystemId;
+    }
+
+private:
     Job* job_;
+    QThreadPool* pool_;
+    QThread::Priority priority_;
+    int queuePriority_;
+    const char* filesystemId_;
+    const char* suspendedFilesystemId_;
+    bool interactive_;
+    bool bulk_;
+
+    static thread_local JobRunner* current_;
 };
 
 } // namespace Fm
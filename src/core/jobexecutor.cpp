@@ -0,0 +1,70 @@
+#include "jobexecutor.h"
+#include "job.h"
+#include "job_p.h"
+#include <mutex>
+
+namespace Fm {
+
+static QThreadPool* threadPools_[3] = {nullptr, nullptr, nullptr};
+static std::mutex threadPoolsMutex_;
+
+static int defaultMaxThreadCount(JobExecutor::Pool pool) {
+    switch(pool) {
+    case JobExecutor::Pool::METADATA_IO:
+        // these jobs mostly wait for I/O, possibly on slow remote filesystems
+        return 16;
+    case JobExecutor::Pool::BULK_IO:
+        return 4;
+    case JobExecutor::Pool::CPU:
+    default:
+        return QThread::idealThreadCount();
+    }
+}
+
+// QThreadPool runs the work with a higher priority value first
+static int queuePriority(QThread::Priority priority) {
+    if(priority == QThread::InheritPriority) {
+        return 0;
+    }
+    return int(priority) - int(QThread::NormalPriority);
+}
+
+// static
+QThreadPool* JobExecutor::threadPool(Pool pool) {
+    std::lock_guard<std::mutex> lock{threadPoolsMutex_};
+    auto& threadPool = threadPools_[int(pool)];
+    if(Q_UNLIKELY(threadPool == nullptr)) {
+        threadPool = new QThreadPool();
+        threadPool->setMaxThreadCount(defaultMaxThreadCount(pool));
+    }
+    return threadPool;
+}
+
+// static
+void JobExecutor::setMaxThreadCount(Pool pool, int maxThreadCount) {
+    threadPool(pool)->setMaxThreadCount(maxThreadCount);
+}
+
+// static
+int JobExecutor::maxThreadCount(Pool pool) {
+    return threadPool(pool)->maxThreadCount();
+}
+
+// static
+void JobExecutor::submit(Job* job, Pool pool, QThread::Priority priority) {
+    if(job->autoDelete()) {
+        QObject::connect(job, &Job::finished, job, &Job::deleteLater);
+    }
+    // interactive jobs are started before the other jobs of the same priority
+    auto runner = new JobRunner(job, threadPool(pool), priority, queuePriority(priority) + (job->isInteractive() ? 1 : 0),
+                                pool != Pool::METADATA_IO);
+    // the jobs waiting for a busy device are queued without taking a thread of the pool
+    IOScheduler::schedule(runner);
+}
+
+// static
+void JobExecutor::start(QRunnable* runnable, Pool pool, QThread::Priority priority) {
+    threadPool(pool)->start(runnable, queuePriority(priority));
+}
+
+} // namespace Fm
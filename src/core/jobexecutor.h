@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __LIBFM_QT_FM_JOB_EXECUTOR_H__
+#define __LIBFM_QT_FM_JOB_EXECUTOR_H__
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include "../libfmqtglobals.h"
+
+namespace Fm {
+
+class Job;
+
+/*
+ * The library-wide executor for jobs and other background work.
+ * Instead of creating a thread for each job, the work is queued in bounded thread pools,
+ * one for each class of work, so that e.g. a large copy cannot starve folder listings.
+ * Within a pool, the work with a higher priority is started first.
+ */
+class LIBFM_QT_API JobExecutor {
+public:
+    enum class Pool {
+        METADATA_IO, // short I/O bound jobs: listing folders, querying file info
+        BULK_IO,     // long I/O bound jobs: copying, deleting, counting sizes
+        CPU          // CPU bound work
+    };
+
+    // Run the job in the pool. If the job has autoDelete() set, it's deleted with
+    // deleteLater() after it finishes (the pool never deletes the job directly).
+    static void submit(Job* job, Pool pool, QThread::Priority priority = QThread::InheritPriority);
+
+    // Run a plain runnable in the pool, which deletes it if autoDelete() is set.
+    static void start(QRunnable* runnable, Pool pool, QThread::Priority priority = QThread::InheritPriority);
+
+    static QThreadPool* threadPool(Pool pool);
+
+    static void setMaxThreadCount(Pool pool, int maxThreadCount);
+
+    static int maxThreadCount(Pool pool);
+};
+
+} // namespace Fm
+
+#endif // __LIBFM_QT_FM_JOB_EXECUTOR_H__
@@ -20,6 +20,10 @@ ThumbnailJob::ThumbnailJob(FileInfoList files, int size):
     files_{std::move(files)},
     size_{size},
     md5Calc_{g_checksum_new(G_CHECKSUM_MD5)} {
+    // the files of a job are usually in the same folder
+    if(!files_.empty()) {
+        setIOFilesystemId(files_.front()->filesystemId());
+    }
 }
 
 ThumbnailJob::~ThumbnailJob() {
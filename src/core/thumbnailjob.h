@@ -21,6 +21,12 @@ public:
         return size_;
     }
 
+    // runAsync() schedules the job with the bulk jobs of its device, so it never delays listings
+    JobExecutor::Pool executorPool() const override {
+        return JobExecutor::Pool::CPU;
+    }
+
+    // NOTE: only kept for compatibility, the jobs started here bypass IOScheduler, use runAsync() instead.
     static QThreadPool* threadPool();
 
     static void setLocalFilesOnly(bool value);
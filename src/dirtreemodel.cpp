@@ -35,6 +35,7 @@ DirTreeModel::~DirTreeModel() {
 void DirTreeModel::addRoots(Fm::FilePathList rootPaths) {
     auto job = new Fm::FileInfoJob{std::move(rootPaths)};
     job->setAutoDelete(true);
+    job->setInteractive(true);
     connect(job, &Fm::FileInfoJob::finished, this, &DirTreeModel::onFileInfoJobFinished, Qt::BlockingQueuedConnection);
     job->runAsync();
 }
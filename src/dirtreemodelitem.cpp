@@ -112,6 +112,12 @@ void DirTreeModelItem::loadFolder() {
             insertFiles(folder_->files());
             onFolderFinishLoading();
         }
+        else if(folder_->isIncremental()) { // add the files loaded so far
+            auto files = folder_->files();
+            if(!files.empty()) {
+                insertFiles(std::move(files));
+            }
+        }
     }
 }
 
@@ -345,7 +351,7 @@ DirTreeModelItem* DirTreeModelItem::childFromPath(Fm::FilePath path, bool recurs
     for(DirTreeModelItem* const item : qAsConst(children_)) {
         // if(item->fileInfo_)
         //  qDebug() << "child: " << QString::fromUtf8(fm_file_info_get_disp_name(item->fileInfo_));
-        if(item->fileInfo_ && item->fileInfo_->path() == path) {
+        if(item->fileInfo_ && item->fileInfo_->hasPath(path)) {
             return item;
         }
         else if(recursive) {
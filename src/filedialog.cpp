@@ -328,6 +328,7 @@ void FileDialog::accept() {
     auto pathList = pathListFromQUrls(selectedFiles_);
     auto job = new FileInfoJob(pathList);
     job->setAutoDelete(true);
+    job->setInteractive(true);
     connect(job, &Job::finished, this, &FileDialog::onFileInfoJobFinished);
     job->runAsync();
 }
@@ -491,7 +492,7 @@ void FileDialog::onSelectionChanged(const QItemSelection& /*selected*/, const QI
             continue;
         }
 
-        auto baseName = fileInfo->path().baseName();
+        const auto& baseName = fileInfo->baseName();
         if(multiple) {
             // support multiple selection
             if(!fileNames.isEmpty()) {
@@ -500,13 +501,13 @@ void FileDialog::onSelectionChanged(const QItemSelection& /*selected*/, const QI
             fileNames += QLatin1Char('\"');
             // escape inside quotes with \ to distinguish between them
             // and the quotes used for separating file names from each other
-            QString name(baseName.get());
+            QString name = QString::fromStdString(baseName);
             fileNames += name.replace(QLatin1String("\""), QLatin1String("\\\""));
             fileNames += QLatin1Char('\"');
         }
         else {
             // support single selection only
-            QString name(baseName.get());
+            QString name = QString::fromStdString(baseName);
             fileNames = name.replace(QLatin1String("\""), QLatin1String("\\\""));
             break;
         }
@@ -30,6 +30,7 @@
 #include "core/untrashjob.h"
 #include "core/filetransferjob.h"
 #include "core/filechangeattrjob.h"
+#include "core/folder.h"
 #include "utilities.h"
 
 namespace Fm {
@@ -177,6 +178,11 @@ bool FileOperation::run() {
     connect(uiTimer_, &QTimer::timeout, this, &FileOperation::onUiTimeout);
 
     if(job_) {
+        // the job is scheduled with the other jobs writing to the same device, or reading from it
+        const auto& path = destPath_ ? destPath_ : srcPaths_.empty() ? Fm::FilePath() : srcPaths_.front();
+        if(path) {
+            job_->setIOFilesystemId(Fm::Folder::knownFilesystemId(path));
+        }
         job_->runAsync();
         return true;
     }
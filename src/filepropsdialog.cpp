@@ -65,6 +65,7 @@ FilePropsDialog::FilePropsDialog(Fm::FileInfoList files, QWidget* parent, Qt::Wi
     }
 
     totalSizeJob = new Fm::TotalSizeJob(fileInfos_.paths(), Fm::TotalSizeJob::DEFAULT);
+    totalSizeJob->setIOFilesystemId(fileInfo->filesystemId());
 
     initGeneralPage();
     initPermissionsPage();
@@ -34,7 +34,26 @@
 
 namespace Fm {
 
+// the batches of files found while a folder is loading are inserted together after this delay (in ms)
+static const int addedFilesDelay = 200;
+// above this number of ranges of consecutive removed rows, a single layout change is used instead
+static const std::size_t maxRemovedRanges = 32;
+
+// move the elements of v to their new rows, the ones without a new row (-1) are dropped
+template <typename T>
+static void compactRows(std::vector<T>& v, const std::vector<int>& newRows, int newCount) {
+    for(std::size_t row = 0; row < newRows.size(); ++row) {
+        int newRow = newRows[row];
+        if(newRow >= 0 && newRow != static_cast<int>(row)) {
+            v[newRow] = std::move(v[row]);
+        }
+    }
+    v.erase(v.begin() + newCount, v.end());
+}
+
 FolderModel::FolderModel():
+    nextItemId_{1},
+    hasPendingAddHandler_{false},
     hasPendingThumbnailHandler_{false},
     showFullNames_{false},
     isLoaded_{false} {
@@ -61,34 +80,68 @@ void FolderModel::setFolder(const std::shared_ptr<Fm::Folder>& new_folder) {
         // handle the case if the folder is already loaded
         if(folder_->isLoaded()) {
             isLoaded_ = true;
-            insertFiles(0, folder_->files());
+            insertFiles(0, *folder_->filesSnapshot());
+        }
+        // an incrementally loaded folder may already have some files
+        else if(folder_->isIncremental()) {
+            insertFiles(0, *folder_->filesSnapshot());
         }
     }
 }
 
 void FolderModel::onStartLoading() {
     isLoaded_ = false;
-    // remove all items
-    removeAll();
+    // NOTE: the items are kept on reloading, the folder only reports the differences.
 }
 
 void FolderModel::onFinishLoading() {
+    insertPendingFiles();
     isLoaded_ = true;
 }
 
 void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
+    if(!isLoaded_ && !items.empty()) {
+        // Each insertion makes proxy models and views update their rows, so the batches found while
+        // the folder is loading are inserted together. The first batch is shown immediately.
+        pendingAddedFiles_.insert(pendingAddedFiles_.end(), files.cbegin(), files.cend());
+        if(!hasPendingAddHandler_) {
+            QTimer::singleShot(addedFilesDelay, this, &FolderModel::insertPendingFiles);
+            hasPendingAddHandler_ = true;
+        }
+        return;
+    }
+    insertPendingFiles(); // keep the order of the files
+    appendFiles(files);
+}
+
+void FolderModel::insertPendingFiles() {
+    hasPendingAddHandler_ = false;
+    if(pendingAddedFiles_.empty()) {
+        return;
+    }
+    Fm::FileInfoList files;
+    files.swap(pendingAddedFiles_);
+    appendFiles(files);
+}
+
+void FolderModel::appendFiles(const Fm::FileInfoList& files) {
     int n_files = files.size();
-    beginInsertRows(QModelIndex(), items.count(), items.count() + n_files - 1);
+    if(n_files == 0) {
+        return;
+    }
+    int firstRow = items.size();
+    beginInsertRows(QModelIndex(), firstRow, firstRow + n_files - 1);
+    reserveRows(firstRow + n_files);
     for(auto& info : files) {
-        FolderModelItem item(info);
         /*
             if(fm_file_info_is_hidden(info)) {
               model->hiddenItems.append(item);
               continue;
             }
         */
-        items.append(item);
+        appendItem(info);
     }
+    indexItems(firstRow);
     endInsertRows();
 
     if(isLoaded_) {
@@ -97,17 +150,21 @@ void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
 }
 
 void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
+    insertPendingFiles(); // the changed files may be pending
     for(auto& change : files) {
         int row;
         auto& oldInfo = change.first;
         auto& newInfo = change.second;
-        QList<FolderModelItem>::iterator it = findItemByFileInfo(oldInfo.get(), &row);
+        auto it = findItemByFileInfo(oldInfo.get(), &row);
         if(it != items.end()) {
             FolderModelItem& item = *it;
-            // try to update the item
+            // try to update the item, it keeps its id
+            unindexItem(item);
             item.info = newInfo;
+            updateItemProperties(row);
+            indexItem(row);
             item.thumbnails.clear();
-            QModelIndex index = createIndex(row, 0, &item);
+            QModelIndex index = this->index(row, 0);
             Q_EMIT dataChanged(index, index);
             if(oldInfo->size() != newInfo->size()) {
                 Q_EMIT fileSizeChanged(index);
@@ -117,15 +174,86 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
 }
 
 void FolderModel::onFilesRemoved(const Fm::FileInfoList& files) {
+    insertPendingFiles(); // the removed files may be pending
+    // find all rows first, and then remove them from the last one, so the rows found stay valid
+    std::vector<int> rows;
+    rows.reserve(files.size());
     for(auto& info : files) {
         int row;
-        QList<FolderModelItem>::iterator it = findItemByName(info->name().c_str(), &row);
+        auto it = findItemByFileInfo(info.get(), &row);
+        if(it == items.end()) {
+            it = findItemByName(info->baseName().c_str(), &row);
+        }
         if(it != items.end()) {
-            beginRemoveRows(QModelIndex(), row, row);
-            items.erase(it);
+            rows.push_back(row);
+        }
+    }
+    if(rows.empty()) {
+        return;
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    for(int row : rows) {
+        unindexItem(items.at(row));
+    }
+    // the ranges of consecutive rows, as indices of their first and last rows in rows
+    std::vector<std::pair<int, int>> ranges;
+    for(int i = 0; i < static_cast<int>(rows.size()); ++i) {
+        if(ranges.empty() || rows[i] != rows[i - 1] + 1) {
+            ranges.emplace_back(i, i);
+        }
+        else {
+            ranges.back().second = i;
+        }
+    }
+    if(ranges.size() > maxRemovedRanges) {
+        removeRowsWithLayoutChange(rows);
+    }
+    else {
+        // remove the ranges from the last one, so the other rows stay valid
+        for(auto it = ranges.crbegin(); it != ranges.crend(); ++it) {
+            int first = rows[it->first];
+            int last = rows[it->second];
+            beginRemoveRows(QModelIndex(), first, last);
+            eraseRows(first, last);
             endRemoveRows();
         }
     }
+    // the rows after the first removed one have changed
+    updateRowIndex(rows.front());
+}
+
+// Each removed range makes proxy models and views update all their rows,
+// so many scattered rows are removed with a single layout change instead.
+void FolderModel::removeRowsWithLayoutChange(const std::vector<int>& sortedRows) {
+    Q_EMIT layoutAboutToBeChanged();
+    std::vector<int> newRows(items.size(), -1);
+    int newCount = 0;
+    auto removedIt = sortedRows.cbegin();
+    for(int row = 0; row < static_cast<int>(items.size()); ++row) {
+        if(removedIt != sortedRows.cend() && *removedIt == row) {
+            ++removedIt;
+            continue;
+        }
+        newRows[row] = newCount++;
+    }
+    // the kept rows only move towards the beginning, so they are compacted in place
+    compactRows(items, newRows, newCount);
+    compactRows(itemIds_, newRows, newCount);
+    compactRows(itemFlags_, newRows, newCount);
+    compactRows(itemSizes_, newRows, newCount);
+    compactRows(itemMtimes_, newRows, newCount);
+    compactRows(itemNames_, newRows, newCount);
+
+    const QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for(const auto& index : oldIndexes) {
+        int newRow = newRows[index.row()];
+        newIndexes.append(newRow >= 0 ? createIndex(newRow, index.column(), itemIds_[newRow]) : QModelIndex());
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+    Q_EMIT layoutChanged();
 }
 
 void FolderModel::loadPendingThumbnails() {
@@ -137,7 +265,7 @@ void FolderModel::loadPendingThumbnails() {
             job->setAutoDelete(true);
             connect(job, &Fm::ThumbnailJob::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded, Qt::BlockingQueuedConnection);
             connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished, Qt::BlockingQueuedConnection);
-            Fm::ThumbnailJob::threadPool()->start(job);
+            job->runAsync(QThread::LowPriority);
         }
     }
 }
@@ -155,11 +283,16 @@ void FolderModel::queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>&
 
 void FolderModel::insertFiles(int row, const Fm::FileInfoList& files) {
     int n_files = files.size();
+    if(n_files == 0) {
+        return;
+    }
     beginInsertRows(QModelIndex(), row, row + n_files - 1);
+    int firstRow = items.size();
+    reserveRows(firstRow + n_files);
     for(auto& info : files) {
-        FolderModelItem item(info);
-        items.append(item);
+        appendItem(info);
     }
+    indexItems(firstRow);
     endInsertRows();
 }
 
@@ -172,22 +305,107 @@ void FolderModel::setCutFiles(const QItemSelection& selection) {
             for(const auto& index : indexes) {
                 auto item = itemFromIndex(index);
                 item->bindCutFiles(cutFilesHashSet);
-                cutFilesHashSet->insert(item->info->path().hash());
+                cutFilesHashSet->insert(item->info->pathHash());
             }
         }
-        Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, 0));
+        // only the look of the items changes, not their sort order
+        Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, 0), {FileIsCutRole, Qt::DecorationRole});
     }
 }
 
 void FolderModel::removeAll() {
+    pendingAddedFiles_.clear();
     if(items.empty()) {
         return;
     }
     beginRemoveRows(QModelIndex(), 0, items.size() - 1);
+    rowIndex_.clear();
+    nameIndex_.clear();
     items.clear();
+    itemIds_.clear();
+    itemFlags_.clear();
+    itemSizes_.clear();
+    itemMtimes_.clear();
+    itemNames_.clear();
     endRemoveRows();
 }
 
+void FolderModel::reserveRows(std::size_t n) {
+    items.reserve(n);
+    itemIds_.reserve(n);
+    itemFlags_.reserve(n);
+    itemSizes_.reserve(n);
+    itemMtimes_.reserve(n);
+    itemNames_.reserve(n);
+}
+
+void FolderModel::appendItem(const std::shared_ptr<const Fm::FileInfo>& info) {
+    items.emplace_back(info);
+    itemIds_.push_back(nextItemId_++);
+    itemFlags_.push_back(0);
+    itemSizes_.push_back(0);
+    itemMtimes_.push_back(0);
+    itemNames_.emplace_back();
+    updateItemProperties(items.size() - 1);
+}
+
+void FolderModel::updateItemProperties(int row) {
+    const Fm::FileInfo* info = items[row].info.get();
+    uint8_t flags = 0;
+    if(info->isDir()) {
+        flags |= ItemIsDir;
+    }
+    if(info->isHidden()) {
+        flags |= ItemIsHidden;
+    }
+    if(info->isBackup()) {
+        flags |= ItemIsBackup;
+    }
+    itemFlags_[row] = flags;
+    itemSizes_[row] = info->size();
+    itemMtimes_[row] = info->mtime();
+    itemNames_[row] = info->displayName();
+}
+
+void FolderModel::eraseRows(int first, int last) {
+    items.erase(items.begin() + first, items.begin() + last + 1);
+    itemIds_.erase(itemIds_.begin() + first, itemIds_.begin() + last + 1);
+    itemFlags_.erase(itemFlags_.begin() + first, itemFlags_.begin() + last + 1);
+    itemSizes_.erase(itemSizes_.begin() + first, itemSizes_.begin() + last + 1);
+    itemMtimes_.erase(itemMtimes_.begin() + first, itemMtimes_.begin() + last + 1);
+    itemNames_.erase(itemNames_.begin() + first, itemNames_.begin() + last + 1);
+}
+
+void FolderModel::indexItem(int row) {
+    const Fm::FileInfo* info = items.at(row).info.get();
+    rowIndex_[info] = row;
+    nameIndex_.emplace(NameKey{&info->baseName()}, info);
+}
+
+void FolderModel::indexItems(int firstRow) {
+    for(int row = firstRow; row < static_cast<int>(items.size()); ++row) {
+        indexItem(row);
+    }
+}
+
+void FolderModel::updateRowIndex(int firstRow) {
+    for(int row = firstRow; row < static_cast<int>(items.size()); ++row) {
+        rowIndex_[items[row].info.get()] = row;
+    }
+}
+
+void FolderModel::unindexItem(const FolderModelItem& item) {
+    const Fm::FileInfo* info = item.info.get();
+    rowIndex_.erase(info);
+    auto range = nameIndex_.equal_range(NameKey{&info->baseName()});
+    for(auto it = range.first; it != range.second; ++it) {
+        if(it->second == info) {
+            nameIndex_.erase(it);
+            break;
+        }
+    }
+}
+
 int FolderModel::rowCount(const QModelIndex& parent) const {
     if(parent.isValid()) {
         return 0;
@@ -203,7 +421,12 @@ int FolderModel::columnCount(const QModelIndex& parent = QModelIndex()) const {
 }
 
 FolderModelItem* FolderModel::itemFromIndex(const QModelIndex& index) const {
-    return reinterpret_cast<FolderModelItem*>(index.internalPointer());
+    int row = index.row();
+    if(!index.isValid() || index.model() != this || row >= static_cast<int>(items.size())
+            || itemIds_[row] != index.internalId()) { // an outdated index
+        return nullptr;
+    }
+    return const_cast<FolderModelItem*>(&items[row]);
 }
 
 std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromIndex(const QModelIndex& index) const {
@@ -212,11 +435,15 @@ std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromIndex(const QModelI
 }
 
 QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRole*/) const {
-    if(!index.isValid() || index.row() > items.size() || index.column() >= NumOfColumns) {
+    if(index.column() >= NumOfColumns) {
         return QVariant();
     }
     FolderModelItem* item = itemFromIndex(index);
-    auto info = item->info;
+    if(!item) {
+        return QVariant();
+    }
+    const int row = index.row();
+    auto& info = item->info;
 
     bool isCut = false;
     if(folder_ && Q_UNLIKELY(folder_->hasCutFiles())) {
@@ -230,7 +457,7 @@ QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRol
         switch(index.column()) {
         case ColumnFileName:
             return (showFullNames_ && !item->name().empty() ? QString::fromStdString(item->name())
-                                                            : item->displayName());
+                                                            : itemNames_[row]);
         case ColumnFileType:
             return QString(info->mimeType()->desc());
         case ColumnFileMTime:
@@ -259,7 +486,7 @@ QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRol
     case FileInfoRole:
         return QVariant::fromValue(info);
     case FileIsDirRole:
-        return QVariant(info->isDir());
+        return QVariant(isDirAt(row));
     case FileIsCutRole:
         return isCut;
     }
@@ -297,11 +524,10 @@ QVariant FolderModel::headerData(int section, Qt::Orientation orientation, int r
 }
 
 QModelIndex FolderModel::index(int row, int column, const QModelIndex& /*parent*/) const {
-    if(row < 0 || row >= items.size() || column < 0 || column >= NumOfColumns) {
+    if(row < 0 || row >= static_cast<int>(items.size()) || column < 0 || column >= NumOfColumns) {
         return QModelIndex();
     }
-    const FolderModelItem& item = items.at(row);
-    return createIndex(row, column, (void*)&item);
+    return createIndex(row, column, itemIds_[row]);
 }
 
 QModelIndex FolderModel::parent(const QModelIndex& /*index*/) const {
@@ -324,54 +550,35 @@ Qt::ItemFlags FolderModel::flags(const QModelIndex& index) const {
     return flags;
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByPath(const Fm::FilePath& path, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        auto item_path = item.info->path();
-        if(item_path == path) {
-            *row = i;
-            return it;
+std::vector<FolderModelItem>::iterator FolderModel::findItemByPath(const Fm::FilePath& path, int* row) {
+    auto name = path.baseName();
+    const std::string nameStr{name.get()};
+    // several files can have the same name in search results
+    auto range = nameIndex_.equal_range(NameKey{&nameStr});
+    for(auto it = range.first; it != range.second; ++it) {
+        if(it->second->hasPath(path)) {
+            return findItemByFileInfo(it->second, row);
         }
-        ++it;
-        ++i;
     }
     return items.end();
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info->name() == name) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+std::vector<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
+    const std::string nameStr{name};
+    auto it = nameIndex_.find(NameKey{&nameStr});
+    if(it == nameIndex_.end()) {
+        return items.end();
     }
-    return items.end();
+    return findItemByFileInfo(it->second, row);
 }
 
-QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info.get() == info) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+std::vector<FolderModelItem>::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
+    auto it = rowIndex_.find(info);
+    if(it == rowIndex_.end()) {
+        return items.end();
     }
-    return items.end();
+    *row = it->second;
+    return items.begin() + it->second;
 }
 
 QStringList FolderModel::mimeTypes() const {
@@ -494,9 +701,7 @@ void FolderModel::releaseThumbnails(int size) {
             }
 
             // remove all cached thumbnails of the specified size
-            QList<FolderModelItem>::iterator itemIt;
-            for(itemIt = items.begin(); itemIt != items.end(); ++itemIt) {
-                FolderModelItem& item = *itemIt;
+            for(auto& item : items) {
                 item.removeThumbnail(size);
             }
             break;
@@ -516,11 +721,11 @@ void FolderModel::onThumbnailJobFinished() {
 void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image) {
     // find the model item this thumbnail belongs to
     int row;
-    QList<FolderModelItem>::iterator it = findItemByFileInfo(file.get(), &row);
+    auto it = findItemByFileInfo(file.get(), &row);
     if(it != items.end()) {
         // the file is found in our model
         FolderModelItem& item = *it;
-        QModelIndex index = createIndex(row, 0, (void*)&item);
+        QModelIndex index = this->index(row, 0);
         // store the image in the folder model item.
         FolderModelItem::Thumbnail* thumbnail = item.findThumbnail(size, false);
         thumbnail->image = image;
@@ -29,7 +29,10 @@
 #include <QList>
 #include <vector>
 #include <utility>
+#include <string>
 #include <forward_list>
+#include <unordered_map>
+#include <cstdint>
 #include "foldermodelitem.h"
 
 #include "core/folder.h"
@@ -99,6 +102,41 @@ public:
         showFullNames_ = fullName;
     }
 
+    bool showFullName() const {
+        return showFullNames_;
+    }
+
+    // The properties used to sort and filter the rows. They are stored contiguously by row,
+    // so sorting and filtering don't need to access the FileInfo of each row.
+    bool isDirAt(int row) const {
+        return itemFlags_[row] & ItemIsDir;
+    }
+
+    bool isHiddenAt(int row) const {
+        return itemFlags_[row] & ItemIsHidden;
+    }
+
+    bool isBackupAt(int row) const {
+        return itemFlags_[row] & ItemIsBackup;
+    }
+
+    quint64 sizeAt(int row) const {
+        return itemSizes_[row];
+    }
+
+    quint64 mtimeAt(int row) const {
+        return itemMtimes_[row];
+    }
+
+    const QString& displayNameAt(int row) const {
+        return itemNames_[row];
+    }
+
+    // the stable id of the item at the row, never reused by the model
+    quintptr itemIdAt(int row) const {
+        return itemIds_[row];
+    }
+
 Q_SIGNALS:
     void thumbnailLoaded(const QModelIndex& index, int size);
     void fileSizeChanged(const QModelIndex& index);
@@ -119,12 +157,48 @@ protected Q_SLOTS:
 protected:
     void queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size);
     void insertFiles(int row, const Fm::FileInfoList& files);
+    void appendFiles(const Fm::FileInfoList& files);
+    void insertPendingFiles();
     void removeAll();
-    QList<FolderModelItem>::iterator findItemByPath(const Fm::FilePath& path, int* row);
-    QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
-    QList<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
+    void removeRowsWithLayoutChange(const std::vector<int>& sortedRows);
+    // NOTE: These returned QList<FolderModelItem>::iterator before the ABI version 7, when the items
+    // were stored in a QList. Subclasses storing the result in a QList iterator need to be ported.
+    std::vector<FolderModelItem>::iterator findItemByPath(const Fm::FilePath& path, int* row);
+    // name is the base name of the path of the file, see FileInfo::baseName()
+    std::vector<FolderModelItem>::iterator findItemByName(const char* name, int* row);
+    std::vector<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
 
 private:
+    enum ItemFlag: uint8_t {
+        ItemIsDir = 1 << 0,
+        ItemIsHidden = 1 << 1,
+        ItemIsBackup = 1 << 2
+    };
+
+    void reserveRows(std::size_t n);
+    void appendItem(const std::shared_ptr<const Fm::FileInfo>& info);
+    void updateItemProperties(int row);
+    void eraseRows(int first, int last);
+    void indexItem(int row);
+    void indexItems(int firstRow);
+    // only update the rows of the indexed items, e.g. after removing the rows before them
+    void updateRowIndex(int firstRow);
+    void unindexItem(const FolderModelItem& item);
+
+    // refers to the base name stored in a FileInfo, so the names are not copied
+    struct NameKey {
+        const std::string* name;
+
+        bool operator==(const NameKey& other) const {
+            return *name == *other.name;
+        }
+    };
+
+    struct NameKeyHash {
+        std::size_t operator()(const NameKey& key) const {
+            return std::hash<std::string>()(*key.name);
+        }
+    };
 
     struct ThumbnailData {
         ThumbnailData(int size):
@@ -138,7 +212,24 @@ private:
     };
 
     std::shared_ptr<Fm::Folder> folder_;
-    QList<FolderModelItem> items;
+    // The items and their properties by row (struct of arrays). An item is identified by
+    // a stable id in QModelIndex::internalId(), so an outdated index is never mistaken for another.
+    std::vector<FolderModelItem> items;
+    std::vector<quintptr> itemIds_;
+    std::vector<uint8_t> itemFlags_;
+    std::vector<quint64> itemSizes_;
+    std::vector<quint64> itemMtimes_;
+    std::vector<QString> itemNames_;
+    quintptr nextItemId_;
+    // the row of each item, so the changes of the folder don't need linear searches.
+    // The rows after a removed one are updated once per batch of removed files.
+    std::unordered_map<const Fm::FileInfo*, int> rowIndex_;
+    // the files of each base name, the names are not unique in search results
+    std::unordered_multimap<NameKey, const Fm::FileInfo*, NameKeyHash> nameIndex_;
+
+    // the files added while the folder is loading, they are inserted together
+    Fm::FileInfoList pendingAddedFiles_;
+    bool hasPendingAddHandler_;
 
     bool hasPendingThumbnailHandler_;
     std::vector<Fm::ThumbnailJob*> pendingThumbnailJobs_;
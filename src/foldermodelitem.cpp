@@ -31,10 +31,13 @@ FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _inf
     thumbnails.reserve(2);
 }
 
-FolderModelItem::FolderModelItem(const FolderModelItem& other):
-    info{other.info},
-    thumbnails{other.thumbnails} {
-}
+FolderModelItem::FolderModelItem(const FolderModelItem& other) = default;
+
+FolderModelItem::FolderModelItem(FolderModelItem&& other) noexcept = default;
+
+FolderModelItem& FolderModelItem::operator=(const FolderModelItem& other) = default;
+
+FolderModelItem& FolderModelItem::operator=(FolderModelItem&& other) noexcept = default;
 
 FolderModelItem::~FolderModelItem() {
 }
@@ -51,8 +51,13 @@ public:
 public:
     explicit FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info);
     FolderModelItem(const FolderModelItem& other);
+    // the items are stored in a vector by FolderModel, so they should be cheap to move
+    FolderModelItem(FolderModelItem&& other) noexcept;
     virtual ~FolderModelItem();
 
+    FolderModelItem& operator=(const FolderModelItem& other);
+    FolderModelItem& operator=(FolderModelItem&& other) noexcept;
+
     const QString& displayName() const {
         return info->displayName();
     }
@@ -47,12 +47,18 @@
 #include "xdndworkaround.h" // for XDS support
 #include "folderview_p.h"
 #include "utilities.h"
+#include "core/folderprefetcher.h"
 
 #define SCROLL_FRAMES_PER_SEC 50
 #define SCROLL_DURATION 300 // in ms
 
 static const int scrollAnimFrames = SCROLL_FRAMES_PER_SEC * SCROLL_DURATION / 1000;
 
+// a hovered folder is prefetched if the mouse pointer rests on it for this delay (in ms)
+static const int hoverPrefetchDelay = 300;
+// the selected folders are not prefetched if more items are selected
+static const int maxSelectionPrefetch = 4;
+
 using namespace Fm;
 
 FolderViewListView::FolderViewListView(QWidget* parent):
@@ -508,6 +514,7 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
     autoSelectionDelay_(600),
     autoSelectionTimer_(nullptr),
     selChangedTimer_(nullptr),
+    hoverPrefetchTimer_(nullptr),
     itemDelegateMargins_(QSize(3, 3)),
     shadowHidden_(false),
     smoothScrollTimer_(nullptr),
@@ -530,6 +537,9 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
 }
 
 FolderView::~FolderView() {
+    if(prefetcher_) {
+        prefetcher_->removeCandidates(this);
+    }
     if(smoothScrollTimer_) {
         disconnect(smoothScrollTimer_, &QTimer::timeout, this, &FolderView::scrollSmoothly);
         smoothScrollTimer_->stop();
@@ -553,9 +563,64 @@ void FolderView::onSelChangedTimeout() {
     selChangedTimer_->deleteLater();
     selChangedTimer_ = nullptr;
     // qDebug()<<"selected:" << nSel;
+    updatePrefetch();
     Q_EMIT selChanged();
 }
 
+// The hovered folder and the selected folders will probably be opened soon.
+void FolderView::updatePrefetch() {
+    if(!prefetcher_ && !FolderPrefetcher::isEnabled()) {
+        return;
+    }
+    Fm::FilePathList paths;
+    if(hoveredDir_) {
+        paths.push_back(hoveredDir_);
+    }
+    if(model_ && selectionModel()) {
+        QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
+        // nothing can be predicted if many items are selected
+        if(selIndexes.size() <= maxSelectionPrefetch) {
+            for(const auto& index: selIndexes) {
+                auto info = model_->fileInfoFromIndex(index);
+                if(info && info->isDir() && !info->isShortcut() && !info->isMountable()) {
+                    paths.push_back(info->path());
+                }
+            }
+        }
+    }
+    if(!prefetcher_) {
+        if(paths.empty()) {
+            return;
+        }
+        prefetcher_ = FolderPrefetcher::globalInstance();
+    }
+    prefetcher_->setCandidates(this, std::move(paths));
+}
+
+void FolderView::onItemHovered(const QModelIndex& index) {
+    if(!FolderPrefetcher::isEnabled()) {
+        return;
+    }
+    std::shared_ptr<const Fm::FileInfo> info;
+    if(index.isValid() && model_) {
+        info = model_->fileInfoFromIndex(index);
+        if(info && (!info->isDir() || info->isShortcut() || info->isMountable())) {
+            info = nullptr;
+        }
+    }
+    if(info ? (hoveredDir_ && info->hasPath(hoveredDir_)) : !hoveredDir_) {
+        return; // still the same folder
+    }
+    hoveredDir_ = info ? info->path() : Fm::FilePath();
+    if(!hoverPrefetchTimer_) {
+        hoverPrefetchTimer_ = new QTimer(this);
+        hoverPrefetchTimer_->setSingleShot(true);
+        connect(hoverPrefetchTimer_, &QTimer::timeout, this, &FolderView::updatePrefetch);
+    }
+    // don't prefetch every folder the mouse pointer passes over
+    hoverPrefetchTimer_->start(hoverPrefetchDelay);
+}
+
 void FolderView::onSelectionChanged(const QItemSelection& /*selected*/, const QItemSelection& /*deselected*/) {
     // It's possible that the selected items change too often and this slot gets called for thousands of times.
     // For example, when you select thousands of files and delete them, we will get one selectionChanged() event
@@ -1144,6 +1209,7 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
     if(view && watched == view->viewport()) {
         switch(event->type()) {
         case QEvent::HoverMove:
+            onItemHovered(view->indexAt(static_cast<QHoverEvent*>(event)->pos()));
             // activate items on single click
             if(style()->styleHint(QStyle::SH_ItemView_ActivateItemOnSingleClick)) {
                 QHoverEvent* hoverEvent = static_cast<QHoverEvent*>(event);
@@ -1166,6 +1232,7 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
             }
             break;
         case QEvent::HoverLeave:
+            onItemHovered(QModelIndex());
             if(style()->styleHint(QStyle::SH_ItemView_ActivateItemOnSingleClick)) {
                 setCursor(Qt::ArrowCursor);
             }
@@ -39,6 +39,7 @@ class FileMenu;
 class FolderMenu;
 class FileLauncher;
 class FolderViewStyle;
+class FolderPrefetcher;
 
 class LIBFM_QT_API FolderView : public QWidget {
     Q_OBJECT
@@ -160,9 +161,13 @@ public Q_SLOTS:
 private Q_SLOTS:
     void onAutoSelectionTimeout();
     void onSelChangedTimeout();
+    void updatePrefetch();
     void onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint);
     void scrollSmoothly();
 
+private:
+    void onItemHovered(const QModelIndex& index);
+
 Q_SIGNALS:
     void clicked(int type, const std::shared_ptr<const Fm::FileInfo>& file);
     void clickedBack();
@@ -181,6 +186,10 @@ private:
     QTimer* autoSelectionTimer_;
     QModelIndex lastAutoSelectionIndex_;
     QTimer* selChangedTimer_;
+    // the hovered and selected folders are loaded in advance
+    std::shared_ptr<FolderPrefetcher> prefetcher_;
+    Fm::FilePath hoveredDir_;
+    QTimer* hoverPrefetchTimer_;
     // the cell margins in the icon and thumbnail modes
     QSize itemDelegateMargins_;
     bool shadowHidden_;
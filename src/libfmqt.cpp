@@ -21,6 +21,7 @@
 #include <QLocale>
 #include <QPixmapCache>
 #include "core/thumbnailer.h"
+#include "core/folder.h"
 #include "xdndworkaround.h"
 #include "core/vfs/fm-file.h"
 #include "core/legacy/fm-config.h"
@@ -75,6 +76,9 @@ LibFmQtData::LibFmQtData(): refCount(1) {
 LibFmQtData::~LibFmQtData() {
     // _fm_file_finalize();
 
+    // release the folders kept alive by the folder cache while the library is still usable
+    Fm::Folder::trimRetainedFolders(0, 0);
+
     GVfs* vfs = g_vfs_get_default();
     g_vfs_unregister_uri_scheme(vfs, "menu");
     g_vfs_unregister_uri_scheme(vfs, "search");
@@ -27,6 +27,7 @@
 #include <QDebug>
 #include <QKeyEvent>
 #include <QDir>
+#include "core/jobexecutor.h"
 
 namespace Fm {
 
@@ -65,7 +66,6 @@ void PathEditJob::runJob() {
     }
     // finished! let's update the UI in the main thread
     Q_EMIT finished();
-    QThread::currentThread()->quit();
 }
 
 
@@ -196,15 +196,12 @@ void PathEdit::reloadCompleter(bool triggeredByFocusInEvent) {
     cancellable_ = g_cancellable_new();
     job->cancellable = (GCancellable*)g_object_ref(cancellable_);
 
-    // launch a new worker thread to handle the job
-    QThread* thread = new QThread();
-    job->moveToThread(thread);
+    // run the job in a worker thread of the shared thread pool
+    // the job is a QObject, so it should be deleted with deleteLater() rather than by the pool
+    job->setAutoDelete(false);
     connect(job, &PathEditJob::finished, this, &PathEdit::onJobFinished, Qt::BlockingQueuedConnection);
-    // connect(job, &PathEditJob::finished, thread, &QThread::quit);
-    connect(thread, &QThread::started, job, &PathEditJob::runJob);
-    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
-    connect(thread, &QThread::finished, job, &QObject::deleteLater);
-    thread->start(QThread::LowPriority);
+    connect(job, &PathEditJob::finished, job, &QObject::deleteLater);
+    JobExecutor::start(job, JobExecutor::Pool::METADATA_IO, QThread::LowPriority);
 }
 
 void PathEdit::freeCompleter() {
@@ -22,12 +22,13 @@
 #define FM_PATHEDIT_P_H
 
 #include <QObject>
+#include <QRunnable>
 
 namespace Fm {
 
 class PathEdit;
 
-class PathEditJob : public QObject {
+class PathEditJob : public QObject, public QRunnable {
     Q_OBJECT
 public:
     GCancellable* cancellable;
@@ -41,6 +42,10 @@ public:
         g_object_unref(cancellable);
     }
 
+    void run() override {
+        runJob();
+    }
+
 Q_SIGNALS:
     void finished();
 
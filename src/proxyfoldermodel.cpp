@@ -19,18 +19,34 @@
 
 
 #include "proxyfoldermodel.h"
+#include "proxyfoldermodel_p.h"
 #include "foldermodel.h"
 #include <QCollator>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 namespace Fm {
 
+// the folders having at least this number of files are sorted in the background
+static const int backgroundSortThreshold = 10000;
+// the minimal number of rows sorted by each task of a sort job
+static const int minSortChunk = 4096;
+// the batches having at least this number of files are merged into the sorted rows at once
+static const int mergeInsertThreshold = 100;
+
 ProxyFolderModel::ProxyFolderModel(QObject* parent):
     QSortFilterProxyModel(parent),
     showHidden_(false),
     backupAsHidden_(true),
     folderFirst_(true),
     showThumbnails_(false),
-    thumbnailSize_(0) {
+    thumbnailSize_(0),
+    sortJob_(nullptr),
+    mergeInsertFirst_(-1),
+    mergeInsertProxyRows_(0) {
 
     setDynamicSortFilter(true);
     setSortCaseSensitivity(Qt::CaseInsensitive);
@@ -39,6 +55,7 @@ ProxyFolderModel::ProxyFolderModel(QObject* parent):
 }
 
 ProxyFolderModel::~ProxyFolderModel() {
+    cancelSortJob();
     if(showThumbnails_ && thumbnailSize_ != 0) {
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
         // tell the source model that we don't need the thumnails anymore
@@ -59,9 +76,18 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
         disconnect(oldSrcModel, SIGNAL(destroyed()), this, SLOT(_q_sourceModelDestroyed()));
     }
 #endif
+    if(oldSrcModel) {
+        disconnect(oldSrcModel, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &ProxyFolderModel::onSourceRowsAboutToBeInserted);
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsInserted);
+    }
+    // the item ids are only unique within a model
+    cancelSortJob();
+    clearSortKeys();
     if(model) {
         // we only support Fm::FolderModel
         Q_ASSERT(model->inherits("Fm::FolderModel"));
+        connect(model, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
 
         if(showThumbnails_ && thumbnailSize_ != 0) { // if we're showing thumbnails
             if(oldSrcModel) { // we need to release cached thumbnails for the old source model
@@ -76,9 +102,29 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
         }
     }
     QSortFilterProxyModel::setSourceModel(model);
+    if(model) {
+        // connected after QSortFilterProxyModel, so the inserted rows are already mapped when they're merged
+        connect(model, &QAbstractItemModel::rowsAboutToBeInserted, this, &ProxyFolderModel::onSourceRowsAboutToBeInserted);
+        connect(model, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsInserted);
+    }
 }
 
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
+    // a newer sort replaces the running one
+    cancelSortJob();
+    // QSortFilterProxyModel::sort() does nothing for the order applied already, so don't compute it
+    if(dynamicSortFilter() && column == sortColumn() && order == sortOrder()) {
+        return;
+    }
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(srcModel && column >= 0 && srcModel->rowCount() >= backgroundSortThreshold) {
+        startSortJob(srcModel, column, order);
+        return;
+    }
+    applySort(column, order);
+}
+
+void ProxyFolderModel::applySort(int column, Qt::SortOrder order) {
     int oldColumn = sortColumn();
     Qt::SortOrder oldOrder = sortOrder();
     QSortFilterProxyModel::sort(column, order);
@@ -114,16 +160,20 @@ void ProxyFolderModel::setFolderFirst(bool folderFirst) {
 
 void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
     collator_.setCaseSensitivity(cs);
+    clearSortKeys();
     QSortFilterProxyModel::setSortCaseSensitivity(cs);
     invalidate();
+    if(sortJob_) { // sort again with the new case sensitivity
+        sort(sortJob_->column, sortJob_->order);
+    }
     Q_EMIT sortFilterChanged();
 }
 
 bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const {
     if(!showHidden_) {
-        if(FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())) {
-            auto info = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if(info && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
+        FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+        if(srcModel && source_row < srcModel->rowCount(source_parent)) {
+            if(srcModel->isHiddenAt(source_row) || (backupAsHidden_ && srcModel->isBackupAt(source_row))) {
                 return false;
             }
         }
@@ -144,24 +194,39 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
     FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // left and right are indexes of source model, not the proxy model.
     if(srcModel) {
-        auto leftInfo = srcModel->fileInfoFromIndex(left);
-        auto rightInfo = srcModel->fileInfoFromIndex(right);
+        // the sort properties are read by row from the source model, without touching the file infos
+        const int leftRow = left.row();
+        const int rightRow = right.row();
 
         if(folderFirst_) {
-            bool leftIsFolder = leftInfo->isDir();
-            bool rightIsFolder = rightInfo->isDir();
+            bool leftIsFolder = srcModel->isDirAt(leftRow);
+            bool rightIsFolder = srcModel->isDirAt(rightRow);
             if(leftIsFolder != rightIsFolder) {
                 return sortOrder() == Qt::AscendingOrder ? leftIsFolder : rightIsFolder;
             }
         }
 
+        if(!sortRanks_.empty()) { // applying an order computed beforehand
+            return sortRanks_[leftRow] < sortRanks_[rightRow];
+        }
+
         int comp;
         switch(sortColumn()) {
-        case FolderModel::ColumnFileMTime:
-            comp = leftInfo->mtime() - rightInfo->mtime();
+        case FolderModel::ColumnFileMTime: {
+            // the difference of two 64-bit values may not fit in an int
+            quint64 leftMtime = srcModel->mtimeAt(leftRow);
+            quint64 rightMtime = srcModel->mtimeAt(rightRow);
+            comp = leftMtime < rightMtime ? -1 : (leftMtime > rightMtime ? 1 : 0);
             break;
-        case FolderModel::ColumnFileSize:
-            comp = leftInfo->size() - rightInfo->size();
+        }
+        case FolderModel::ColumnFileSize: {
+            quint64 leftSize = srcModel->sizeAt(leftRow);
+            quint64 rightSize = srcModel->sizeAt(rightRow);
+            comp = leftSize < rightSize ? -1 : (leftSize > rightSize ? 1 : 0);
+            break;
+        }
+        case FolderModel::ColumnFileName:
+            comp = compareNames(srcModel, leftRow, rightRow);
             break;
         default: {
             QString leftText = left.data(Qt::DisplayRole).toString();
@@ -170,15 +235,193 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
             break;
         }
         }
-        // always sort files by their display names when they have the same property
-        if(comp == 0) {
-            return collator_.compare(leftInfo->displayName(), rightInfo->displayName()) < 0;
+        // always sort files by their names when they have the same property
+        if(comp == 0 && sortColumn() != FolderModel::ColumnFileName) {
+            return compareNames(srcModel, leftRow, rightRow) < 0;
         }
         return comp < 0;
     }
     return QSortFilterProxyModel::lessThan(left, right);
 }
 
+int ProxyFolderModel::compareNames(FolderModel* srcModel, int leftRow, int rightRow) const {
+    if(sortKeys_.size() < static_cast<std::size_t>(srcModel->rowCount())) {
+        // grow the cache before getting any key, so the references stay valid
+        sortKeys_.resize(srcModel->rowCount(), SortKey{0, false, collator_.sortKey(QString())});
+    }
+    return nameSortKey(srcModel, leftRow).compare(nameSortKey(srcModel, rightRow));
+}
+
+const QCollatorSortKey& ProxyFolderModel::nameSortKey(FolderModel* srcModel, int row) const {
+    SortKey& sortKey = sortKeys_[row];
+    const quintptr itemId = srcModel->itemIdAt(row);
+    const bool fullName = srcModel->showFullName();
+    if(sortKey.itemId != itemId || sortKey.fullName != fullName) {
+        // the same text as shown in the name column
+        QString name = fullName ? srcModel->data(srcModel->index(row, FolderModel::ColumnFileName)).toString()
+                                : srcModel->displayNameAt(row);
+        sortKey.itemId = itemId;
+        sortKey.fullName = fullName;
+        sortKey.key = collator_.sortKey(name);
+    }
+    return sortKey.key;
+}
+
+void ProxyFolderModel::clearSortKeys() {
+    sortKeys_.clear();
+    sortKeys_.shrink_to_fit();
+}
+
+void ProxyFolderModel::startSortJob(FolderModel* srcModel, int column, Qt::SortOrder order) {
+    // copy what the job needs, so the model can change while it's sorting
+    const bool fullNames = srcModel->showFullName();
+    auto job = new ProxyFolderModelSortJob{collator_, fullNames};
+    job->column = column;
+    job->order = order;
+    const int n_rows = srcModel->rowCount();
+    job->itemIds.reserve(n_rows);
+    job->names.reserve(n_rows);
+    for(int row = 0; row < n_rows; ++row) {
+        job->itemIds.push_back(srcModel->itemIdAt(row));
+        job->names.push_back(fullNames ? srcModel->data(srcModel->index(row, FolderModel::ColumnFileName)).toString()
+                                       : srcModel->displayNameAt(row));
+        switch(column) {
+        case FolderModel::ColumnFileName:
+            break;
+        case FolderModel::ColumnFileMTime:
+            job->values.push_back(srcModel->mtimeAt(row));
+            break;
+        case FolderModel::ColumnFileSize:
+            job->values.push_back(srcModel->sizeAt(row));
+            break;
+        default:
+            job->texts.push_back(srcModel->data(srcModel->index(row, column)).toString());
+            break;
+        }
+    }
+    job->setAutoDelete(true);
+    connect(job, &Job::finished, this, &ProxyFolderModel::onSortJobFinished, Qt::BlockingQueuedConnection);
+    sortJob_ = job;
+    // the user is waiting for it
+    job->runAsync(QThread::HighPriority);
+}
+
+void ProxyFolderModel::cancelSortJob() {
+    if(sortJob_) {
+        disconnect(sortJob_, nullptr, this, nullptr);
+        sortJob_->cancel();
+        sortJob_ = nullptr;
+    }
+}
+
+void ProxyFolderModel::onSortJobFinished() {
+    auto job = static_cast<ProxyFolderModelSortJob*>(sender());
+    if(job == nullptr || job != sortJob_) { // a cancelled sort
+        return;
+    }
+    sortJob_ = nullptr;
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(job->isCancelled() || srcModel == nullptr) {
+        return;
+    }
+    // The source rows may have changed while sorting. The computed keys are kept
+    // for the rows which still have the same item, and the computed order is used
+    // only if all rows are the same, otherwise the rows are sorted here with the keys.
+    const int n_rows = srcModel->rowCount();
+    bool rowsChanged = n_rows != static_cast<int>(job->itemIds.size());
+    if(sortKeys_.size() < static_cast<std::size_t>(n_rows)) {
+        sortKeys_.resize(n_rows, SortKey{0, false, collator_.sortKey(QString())});
+    }
+    const int n_common = std::min(n_rows, static_cast<int>(job->itemIds.size()));
+    for(int row = 0; row < n_common; ++row) {
+        const quintptr itemId = srcModel->itemIdAt(row);
+        if(itemId == job->itemIds[row]) {
+            sortKeys_[row] = SortKey{itemId, job->fullNames, job->nameKeys[row]};
+        }
+        else {
+            rowsChanged = true;
+        }
+    }
+    if(!rowsChanged) {
+        sortRanks_.swap(job->ranks);
+    }
+    // reorder the rows with a single layout change
+    applySort(job->column, job->order);
+    sortRanks_.clear();
+}
+
+// For each inserted row, QSortFilterProxyModel searches its sorted position with lessThan(),
+// and inserts each range of consecutive rows separately, shifting the mapping and updating
+// the views every time. So large batches are inserted unsorted at the end instead, and then
+// merged into the sorted rows with a single layout change.
+void ProxyFolderModel::onSourceRowsAboutToBeInserted(const QModelIndex& parent, int first, int last) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!parent.isValid() && srcModel && dynamicSortFilter() && sortColumn() >= 0
+            && last - first + 1 >= mergeInsertThreshold
+            && first == srcModel->rowCount()) { // FolderModel appends the new files
+        mergeInsertFirst_ = first;
+        mergeInsertProxyRows_ = rowCount();
+        // the new rows are appended without sorting
+        setDynamicSortFilter(false);
+    }
+}
+
+void ProxyFolderModel::onSourceRowsInserted(const QModelIndex& /*parent*/, int first, int /*last*/) {
+    if(mergeInsertFirst_ != first) {
+        return;
+    }
+    mergeInsertFirst_ = -1;
+    mergeInsertedRows(static_cast<FolderModel*>(sourceModel()), first);
+}
+
+void ProxyFolderModel::mergeInsertedRows(FolderModel* srcModel, int first) {
+    // the source rows in the order of the proxy: the sorted old rows, followed by the new rows
+    const int n_old = mergeInsertProxyRows_;
+    const int n_rows = rowCount();
+    std::vector<int> rows;
+    rows.reserve(n_rows);
+    for(int row = 0; row < n_rows; ++row) {
+        rows.push_back(mapToSource(index(row, 0)).row());
+    }
+    const bool appended = n_old <= n_rows && std::all_of(rows.cbegin() + n_old, rows.cend(), [first](int row) {
+        return row >= first;
+    });
+    if(appended) {
+        const int column = sortColumn();
+        const bool ascending = sortOrder() == Qt::AscendingOrder;
+        // whether the source row left is shown before the source row right
+        auto isBefore = [this, srcModel, column, ascending](int left, int right) {
+            QModelIndex leftIndex = srcModel->index(left, column);
+            QModelIndex rightIndex = srcModel->index(right, column);
+            return ascending ? lessThan(leftIndex, rightIndex) : lessThan(rightIndex, leftIndex);
+        };
+        // sort the new rows, and merge them with the old ones in one pass
+        std::stable_sort(rows.begin() + n_old, rows.end(), isBefore);
+        std::vector<int> merged(n_rows);
+        std::merge(rows.cbegin(), rows.cbegin() + n_old, rows.cbegin() + n_old, rows.cend(), merged.begin(), isBefore);
+        // lessThan() compares the positions in ascending order, QSortFilterProxyModel reverses them if needed
+        sortRanks_.assign(srcModel->rowCount(), 0);
+        for(int i = 0; i < n_rows; ++i) {
+            sortRanks_[merged[i]] = ascending ? i : n_rows - 1 - i;
+        }
+    }
+    // this reorders the rows with a single layout change, by comparing the computed positions
+    // (falls back to a full sort if the new rows were not simply appended)
+    setDynamicSortFilter(true);
+    sortRanks_.clear();
+}
+
+void ProxyFolderModel::onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles) {
+    // a renamed file keeps its item id, so its key is dropped here
+    if(!roles.isEmpty() && !roles.contains(Qt::DisplayRole)) {
+        return;
+    }
+    const int last = std::min(bottomRight.row(), static_cast<int>(sortKeys_.size()) - 1);
+    for(int row = topLeft.row(); row <= last; ++row) {
+        sortKeys_[row].itemId = 0;
+    }
+}
+
 std::shared_ptr<const Fm::FileInfo> ProxyFolderModel::fileInfoFromIndex(const QModelIndex& index) const {
     if(index.isValid()) {
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
@@ -196,7 +439,7 @@ QModelIndex ProxyFolderModel::indexFromPath(const FilePath &path) const {
     for(int row = 0; row < n_rows; ++row) {
         auto idx = index(row, FolderModel::ColumnFileName, QModelIndex());
         auto fi = fileInfoFromIndex(idx);
-        if(fi && fi->path() == path) { // found the item
+        if(fi && fi->hasPath(path)) { // found the item
             ret = idx;
             break;
         }
@@ -324,4 +567,156 @@ void ProxyFolderModel::reloadAllThumbnails() {
 #endif
 
 
+namespace {
+
+// Runs the tasks of a parallel loop. The tasks are taken from a shared counter by the
+// thread running the loop and by helpers started in the pool. The loop only waits for
+// the tasks which are already running, so it can't deadlock when the pool is full.
+struct ParallelTasks {
+    ParallelTasks(int count, const std::function<void (int)>* task):
+        count{count},
+        next{0},
+        finished{0},
+        task{task} {
+    }
+
+    void run() {
+        for(int i = next++; i < count; i = next++) {
+            (*task)(i);
+            std::lock_guard<std::mutex> lock{mutex};
+            if(++finished == count) {
+                cond.notify_all();
+            }
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock{mutex};
+        cond.wait(lock, [this]() {
+            return finished == count;
+        });
+    }
+
+    const int count;
+    std::atomic<int> next;
+    int finished; // guarded by mutex
+    const std::function<void (int)>* task; // only used while there are tasks left
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+class ParallelTasksHelper : public QRunnable {
+public:
+    explicit ParallelTasksHelper(std::shared_ptr<ParallelTasks> tasks): tasks_{std::move(tasks)} {
+    }
+
+    void run() override {
+        tasks_->run();
+    }
+
+private:
+    std::shared_ptr<ParallelTasks> tasks_;
+};
+
+} // namespace
+
+ProxyFolderModelSortJob::ProxyFolderModelSortJob(const QCollator& collator, bool fullNames):
+    column{FolderModel::ColumnFileName},
+    order{Qt::AscendingOrder},
+    fullNames{fullNames},
+    locale_{collator.locale()},
+    caseSensitivity_{collator.caseSensitivity()},
+    numericMode_{collator.numericMode()},
+    ignorePunctuation_{collator.ignorePunctuation()} {
+}
+
+// QCollator is not thread-safe, so each task uses its own one
+QCollator ProxyFolderModelSortJob::createCollator() const {
+    QCollator collator{locale_};
+    collator.setCaseSensitivity(caseSensitivity_);
+    collator.setNumericMode(numericMode_);
+    collator.setIgnorePunctuation(ignorePunctuation_);
+    return collator;
+}
+
+void ProxyFolderModelSortJob::parallelFor(int count, const std::function<void (int)>& task) {
+    auto tasks = std::make_shared<ParallelTasks>(count, &task);
+    const int n_helpers = std::min(count, JobExecutor::maxThreadCount(JobExecutor::Pool::CPU)) - 1;
+    for(int i = 0; i < n_helpers; ++i) {
+        JobExecutor::start(new ParallelTasksHelper{tasks}, JobExecutor::Pool::CPU, QThread::HighPriority);
+    }
+    tasks->run();
+    tasks->wait();
+}
+
+void ProxyFolderModelSortJob::exec() {
+    const int n_rows = names.size();
+    const int n_chunks = std::max(1, std::min(JobExecutor::maxThreadCount(JobExecutor::Pool::CPU), n_rows / minSortChunk));
+    auto chunkStart = [n_rows, n_chunks](int chunk) {
+        return static_cast<int>(static_cast<qint64>(n_rows) * chunk / n_chunks);
+    };
+
+    const QCollatorSortKey emptyKey = createCollator().sortKey(QString());
+    nameKeys.assign(n_rows, emptyKey);
+    std::vector<QCollatorSortKey> textKeys;
+    if(!texts.empty()) {
+        textKeys.assign(n_rows, emptyKey);
+    }
+    // the same order as ProxyFolderModel::lessThan() in ascending order, without putting folders first
+    auto lessThan = [this, &textKeys](int left, int right) {
+        int comp = 0;
+        if(!values.empty()) {
+            comp = values[left] < values[right] ? -1 : (values[left] > values[right] ? 1 : 0);
+        }
+        else if(!textKeys.empty()) {
+            comp = textKeys[left].compare(textKeys[right]);
+        }
+        if(comp == 0) {
+            comp = nameKeys[left].compare(nameKeys[right]);
+        }
+        return comp != 0 ? comp < 0 : left < right;
+    };
+
+    // compute the keys and sort each chunk of rows
+    std::vector<int> rows(n_rows);
+    std::iota(rows.begin(), rows.end(), 0);
+    parallelFor(n_chunks, [&](int chunk) {
+        if(isCancelled()) {
+            return;
+        }
+        QCollator collator = createCollator();
+        const int first = chunkStart(chunk);
+        const int last = chunkStart(chunk + 1);
+        for(int row = first; row < last; ++row) {
+            nameKeys[row] = collator.sortKey(names[row]);
+            if(!texts.empty()) {
+                textKeys[row] = collator.sortKey(texts[row]);
+            }
+        }
+        std::sort(rows.begin() + first, rows.begin() + last, lessThan);
+    });
+
+    // merge the sorted chunks pairwise
+    std::vector<int> merged(n_rows);
+    for(int width = 1; width < n_chunks && !isCancelled(); width *= 2) {
+        const int n_merges = (n_chunks + 2 * width - 1) / (2 * width);
+        parallelFor(n_merges, [&](int i) {
+            const int first = chunkStart(2 * i * width);
+            const int middle = chunkStart(std::min((2 * i + 1) * width, n_chunks));
+            const int last = chunkStart(std::min((2 * i + 2) * width, n_chunks));
+            std::merge(rows.begin() + first, rows.begin() + middle, rows.begin() + middle, rows.begin() + last,
+                       merged.begin() + first, lessThan);
+        });
+        rows.swap(merged);
+    }
+    if(isCancelled()) {
+        return;
+    }
+
+    ranks.resize(n_rows);
+    for(int i = 0; i < n_rows; ++i) {
+        ranks[rows[i]] = i;
+    }
+}
+
 } // namespace Fm
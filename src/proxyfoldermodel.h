@@ -25,6 +25,7 @@
 #include <QSortFilterProxyModel>
 #include <QList>
 #include <QCollator>
+#include <vector>
 
 #include "core/fileinfo.h"
 
@@ -32,8 +33,10 @@ namespace Fm {
 
 // a proxy model used to sort and filter FolderModel
 
+class FolderModel;
 class FolderModelItem;
 class ProxyFolderModel;
+class ProxyFolderModelSortJob;
 
 class LIBFM_QT_API ProxyFolderModelFilter {
 public:
@@ -51,6 +54,12 @@ public:
     // only Fm::FolderModel is allowed for being sourceModel
     virtual void setSourceModel(QAbstractItemModel* model);
 
+    // Large folders are sorted in the background. Then sortColumn() and sortOrder()
+    // change only when the rows are reordered.
+    bool isSorting() const {
+        return sortJob_ != nullptr;
+    }
+
     void setShowHidden(bool show);
     bool showHidden() const {
         return showHidden_;
@@ -99,13 +108,44 @@ Q_SIGNALS:
 protected Q_SLOTS:
     void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
 
+private Q_SLOTS:
+    void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+    void onSortJobFinished();
+    void onSourceRowsAboutToBeInserted(const QModelIndex& parent, int first, int last);
+    void onSourceRowsInserted(const QModelIndex& parent, int first, int last);
+
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const;
     // void reloadAllThumbnails();
 
 private:
+    struct SortKey {
+        quintptr itemId; // the id of the source item the key belongs to, 0 if not computed
+        bool fullName; // the key is made of the full name instead of the display name
+        QCollatorSortKey key;
+    };
+
+    int compareNames(FolderModel* srcModel, int leftRow, int rightRow) const;
+    const QCollatorSortKey& nameSortKey(FolderModel* srcModel, int row) const;
+    void clearSortKeys();
+    void applySort(int column, Qt::SortOrder order);
+    void startSortJob(FolderModel* srcModel, int column, Qt::SortOrder order);
+    void cancelSortJob();
+    void mergeInsertedRows(FolderModel* srcModel, int first);
+
     QCollator collator_;
+    // The collation keys of the file names by source row, computed once and
+    // compared directly when sorting. A key is used only if the item at the row
+    // still has the same id, so the rows moved by the source model are recomputed.
+    mutable std::vector<SortKey> sortKeys_;
+    ProxyFolderModelSortJob* sortJob_;
+    // the positions of the source rows computed beforehand, only used while they are applied
+    std::vector<int> sortRanks_;
+    // the first source row of a large batch being inserted, -1 if none
+    int mergeInsertFirst_;
+    // the number of rows of the proxy before the batch is inserted
+    int mergeInsertProxyRows_;
     bool showHidden_;
     bool backupAsHidden_;
     bool folderFirst_;
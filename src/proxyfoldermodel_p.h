@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 - 2015  Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef FM_PROXYFOLDERMODEL_P_H
+#define FM_PROXYFOLDERMODEL_P_H
+
+#include <QCollator>
+#include <QLocale>
+#include <QString>
+#include <vector>
+#include <functional>
+#include "core/job.h"
+
+namespace Fm {
+
+// Sorts the rows of a large folder with the CPU pool of JobExecutor.
+// The properties of the rows are copied from the model when the job is created,
+// so the job never touches the model.
+class ProxyFolderModelSortJob : public Job {
+    Q_OBJECT
+public:
+    explicit ProxyFolderModelSortJob(const QCollator& collator, bool fullNames);
+
+    JobExecutor::Pool executorPool() const override {
+        return JobExecutor::Pool::CPU;
+    }
+
+    int column;
+    Qt::SortOrder order;
+    // the name column shows the full names instead of the display names
+    bool fullNames;
+    // the ids of the source items by row, when the job was created
+    std::vector<quintptr> itemIds;
+    // the names of the rows, which also sort the rows having the same property
+    std::vector<QString> names;
+    // the sorted property of the rows: values for the size and mtime columns,
+    // texts for the other columns except the name column
+    std::vector<quint64> values;
+    std::vector<QString> texts;
+
+    // the results: the position of each row in the ascending order, and the collation keys of the names
+    std::vector<int> ranks;
+    std::vector<QCollatorSortKey> nameKeys;
+
+protected:
+    void exec() override;
+
+private:
+    QCollator createCollator() const;
+    void parallelFor(int count, const std::function<void (int)>& task);
+
+    QLocale locale_;
+    Qt::CaseSensitivity caseSensitivity_;
+    bool numericMode_;
+    bool ignorePunctuation_;
+};
+
+}
+
+#endif // FM_PROXYFOLDERMODEL_P_H
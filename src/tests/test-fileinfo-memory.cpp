@@ -0,0 +1,58 @@
+#include <QApplication>
+#include <QDebug>
+#include <QFile>
+#include <malloc.h>
+#include "../core/dirlistjob.h"
+#include "test-manyfiles.h"
+
+// Measure the heap memory used per FileInfo object when a folder is listed.
+// Usage: test-fileinfo-memory [folder]
+// If no folder is given, a temporary folder containing 100,000 empty files is created.
+// The FileInfo objects of a local folder listed with DirListJob::FAST (used by Fm::Folder
+// when Folder::setDeferContentTest(true) is called, otherwise DETAILED is used) should stay
+// below 300 bytes per entry for names shorter than 16 bytes.
+// NOTE: the shared MIME types and icons are loaded by a first listing which is not measured.
+
+static size_t heapUsage() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (unsigned int)mallinfo().uordblks;
+#else
+    return 0; // not supported
+#endif
+}
+
+static Fm::FileInfoList listFolder(const Fm::FilePath& path, Fm::DirListJob::Flags flags) {
+    Fm::DirListJob job{path, flags};
+    job.setAutoDelete(false);
+    job.run();
+    return job.files();
+}
+
+static void measure(const Fm::FilePath& path, Fm::DirListJob::Flags flags, const char* name) {
+    listFolder(path, flags); // warm up the caches
+    size_t before = heapUsage();
+    auto files = listFolder(path, flags);
+    size_t after = heapUsage();
+    if(files.empty()) {
+        qDebug("%s: the folder is empty", name);
+        return;
+    }
+    qDebug("%s: %zu files, %zu bytes in total, %.1f bytes per entry",
+           name, files.size(), after - before, double(after - before) / files.size());
+}
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    QTemporaryDir tmpDir;
+    QString dirPath = manyFilesFolder(argc, argv, tmpDir);
+    auto path = Fm::FilePath::fromLocalPath(QFile::encodeName(dirPath).constData());
+
+    qDebug("sizeof(Fm::FileInfo): %zu bytes", sizeof(Fm::FileInfo));
+    measure(path, Fm::DirListJob::FAST, "native (FAST)");
+    measure(path, Fm::DirListJob::DETAILED, "GIO (DETAILED)");
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <QApplication>
+#include <QDebug>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <algorithm>
+#include "../core/fileinfoarena.h"
+#include "test-manyfiles.h"
+
+// Compare FileInfo objects allocated one by one with std::make_shared with the ones
+// allocated in slabs by FileInfoArena, as done by DirListJob and FileInfoJob.
+// Usage: test-fileinfoarena [number of files] [rounds]
+// The files are sorted by their display names like ProxyFolderModel::lessThan() does.
+
+struct Timings {
+    double create;
+    double sort;
+    double destroy;
+};
+
+template <typename CreateFunc>
+static Timings run(size_t n_files, const struct stat& st, const Fm::FilePath& dirPath, CreateFunc create) {
+    Timings timings;
+    QElapsedTimer timer;
+    timer.start();
+    Fm::FileInfoList files;
+    files.reserve(n_files);
+    for(size_t i = 0; i < n_files; ++i) {
+        // not in the order of the names
+        auto info = create();
+        setFakeFileInfo(*info, st, dirPath, i, n_files);
+        files.push_back(std::move(info));
+    }
+    timings.create = timer.nsecsElapsed() / 1e9;
+
+    // the display names are decoded on first use, so do it before timing the sort
+    for(auto& file: files) {
+        file->displayName();
+    }
+    QCollator collator;
+    collator.setNumericMode(true);
+    timer.restart();
+    std::sort(files.begin(), files.end(), [&collator](const std::shared_ptr<const Fm::FileInfo>& a, const std::shared_ptr<const Fm::FileInfo>& b) {
+        if(a->isDir() != b->isDir()) {
+            return a->isDir();
+        }
+        return collator.compare(a->displayName(), b->displayName()) < 0;
+    });
+    timings.sort = timer.nsecsElapsed() / 1e9;
+
+    timer.restart();
+    files.clear();
+    files.shrink_to_fit();
+    timings.destroy = timer.nsecsElapsed() / 1e9;
+    return timings;
+}
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    size_t n_files = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 3;
+
+    struct stat st;
+    if(!fakeFileStat(argv[0], st)) {
+        return 1;
+    }
+    auto dirPath = Fm::FilePath::fromLocalPath("/tmp");
+
+    for(int i = 0; i < rounds; ++i) {
+        auto single = run(n_files, st, dirPath, []() {
+            return std::make_shared<Fm::FileInfo>();
+        });
+        Fm::FileInfoArena arena;
+        auto slabs = run(n_files, st, dirPath, [&arena]() {
+            return arena.create();
+        });
+        qDebug("round %d: %zu files", i + 1, n_files);
+        qDebug("    make_shared: create %.3f s, sort %.3f s, destroy %.3f s", single.create, single.sort, single.destroy);
+        qDebug("    arena:       create %.3f s, sort %.3f s, destroy %.3f s", slabs.create, slabs.sort, slabs.destroy);
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <QApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include "../foldermodel.h"
+#include "test-manyfiles.h"
+
+// Measure how FolderModel handles bursts of changed and removed files in a large folder,
+// e.g. when many files are deleted at once.
+// Usage: test-foldermodel-index [number of files] [number of files changed/removed]
+
+// the slots handling the changes of the folder are protected
+class BenchModel: public Fm::FolderModel {
+public:
+    using Fm::FolderModel::onFilesAdded;
+    using Fm::FolderModel::onFilesChanged;
+    using Fm::FolderModel::onFilesRemoved;
+    using Fm::FolderModel::findItemByPath;
+};
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    size_t n_files = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t n_burst = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000;
+    if(n_files == 0 || n_burst == 0 || n_burst > n_files) {
+        qDebug() << "invalid number of files";
+        return 1;
+    }
+
+    struct stat st;
+    if(!fakeFileStat(argv[0], st)) {
+        return 1;
+    }
+    auto dirPath = Fm::FilePath::fromLocalPath("/tmp");
+
+    Fm::FileInfoList files;
+    files.reserve(n_files);
+    for(size_t i = 0; i < n_files; ++i) {
+        auto info = std::make_shared<Fm::FileInfo>();
+        setFakeFileInfo(*info, st, dirPath, i, n_files, false);
+        files.push_back(std::move(info));
+    }
+
+    BenchModel model;
+    QElapsedTimer timer;
+    timer.start();
+    model.onFilesAdded(files);
+    qDebug("add %zu files: %.3f s", n_files, timer.nsecsElapsed() / 1e9);
+
+    // the files of a burst are spread over the whole folder
+    const size_t step = n_files / n_burst;
+    std::vector<Fm::FileInfoPair> changes;
+    for(size_t i = 0; i < n_burst; ++i) {
+        auto& oldInfo = files[i * step];
+        auto newInfo = std::make_shared<Fm::FileInfo>(*oldInfo);
+        changes.push_back(std::make_pair(oldInfo, newInfo));
+    }
+    timer.restart();
+    model.onFilesChanged(changes);
+    qDebug("change %zu files: %.3f s", n_burst, timer.nsecsElapsed() / 1e9);
+
+    // remove the new infos of the changed files
+    Fm::FileInfoList removed;
+    for(auto& change: changes) {
+        removed.push_back(change.second);
+    }
+    timer.restart();
+    model.onFilesRemoved(removed);
+    qDebug("remove %zu files: %.3f s", n_burst, timer.nsecsElapsed() / 1e9);
+
+    if(static_cast<size_t>(model.rowCount()) != n_files - n_burst) {
+        qDebug() << "wrong number of rows:" << model.rowCount();
+        return 1;
+    }
+
+    // search results may contain several files with the same name,
+    // each of them should still be found after removing another one
+    Fm::FileInfoList sameName;
+    for(auto& path: {dirPath, Fm::FilePath::fromLocalPath("/var/tmp")}) {
+        auto info = std::make_shared<Fm::FileInfo>();
+        info->setFromStat(AT_FDCWD, "same-name.txt", st, path, false);
+        sameName.push_back(std::move(info));
+    }
+    model.onFilesAdded(sameName);
+    Fm::FileInfoList removedFirst;
+    removedFirst.push_back(sameName.front());
+    model.onFilesRemoved(removedFirst);
+    int row = -1;
+    model.findItemByPath(sameName.back()->path(), &row);
+    if(row < 0 || model.fileInfoFromIndex(model.index(row, 0)) != sameName.back()) {
+        qDebug() << "a file with a duplicate name cannot be found";
+        return 1;
+    }
+    return 0;
+}
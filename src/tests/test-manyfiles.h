@@ -0,0 +1,47 @@
+#ifndef TEST_MANYFILES_H
+#define TEST_MANYFILES_H
+
+#include <QDebug>
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../core/fileinfo.h"
+
+// The folder used by the listing benchmarks: the one given as the first argument or,
+// if there is none, tmpDir filled with n_files empty files.
+static inline QString manyFilesFolder(int argc, char** argv, const QTemporaryDir& tmpDir, int n_files = 100000) {
+    if(argc > 1) {
+        return QString::fromLocal8Bit(argv[1]);
+    }
+    qDebug() << "creating" << n_files << "files in" << tmpDir.path();
+    for(int i = 0; i < n_files; ++i) {
+        QFile file{tmpDir.path() + QStringLiteral("/file-%1.txt").arg(i)};
+        file.open(QIODevice::WriteOnly);
+    }
+    return tmpDir.path();
+}
+
+// The stat of a regular file used by the benchmarks which make FileInfo objects without
+// listing a folder: the one of the test program itself, turned into a regular file.
+static inline bool fakeFileStat(const char* argv0, struct stat& st) {
+    if(stat(argv0, &st) != 0) {
+        qDebug() << "cannot stat" << argv0;
+        return false;
+    }
+    st.st_mode = (st.st_mode & ~S_IFMT) | S_IFREG;
+    return true;
+}
+
+// Set the info of the i-th of n_files fake files of dirPath, named "file-<number>.txt".
+// If shuffled is true, the names are not in the order of i.
+static inline void setFakeFileInfo(Fm::FileInfo& info, const struct stat& st, const Fm::FilePath& dirPath,
+                                   size_t i, size_t n_files, bool shuffled = true) {
+    char name[64];
+    snprintf(name, sizeof(name), "file-%zu.txt", shuffled ? (i * 7919) % n_files : i);
+    info.setFromStat(AT_FDCWD, name, st, dirPath, false);
+}
+
+#endif // TEST_MANYFILES_H
@@ -0,0 +1,113 @@
+#include <QApplication>
+#include <QCollator>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <numeric>
+#include "../foldermodel.h"
+#include "../proxyfoldermodel.h"
+#include "test-manyfiles.h"
+
+// Check the order computed by the background sort of ProxyFolderModel against std::stable_sort,
+// and measure how long it takes.
+// Usage: test-proxyfoldermodel-sort [number of files]
+
+class TestModel: public Fm::FolderModel {
+public:
+    using Fm::FolderModel::onFilesAdded;
+    using Fm::FolderModel::insertPendingFiles;
+};
+
+static double sortAndWait(Fm::ProxyFolderModel& proxy, int column, Qt::SortOrder order) {
+    QElapsedTimer timer;
+    timer.start();
+    proxy.sort(column, order);
+    while(proxy.isSorting()) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return timer.nsecsElapsed() / 1e9;
+}
+
+// compare the rows of the proxy model with the source rows sorted by std::stable_sort
+static bool checkOrder(const Fm::ProxyFolderModel& proxy, const TestModel& model, int column, Qt::SortOrder order) {
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    std::vector<int> rows(model.rowCount());
+    std::iota(rows.begin(), rows.end(), 0);
+    std::stable_sort(rows.begin(), rows.end(), [&](int left, int right) {
+        int comp = 0;
+        if(column == Fm::FolderModel::ColumnFileSize) {
+            comp = model.sizeAt(left) < model.sizeAt(right) ? -1 : (model.sizeAt(left) > model.sizeAt(right) ? 1 : 0);
+        }
+        if(comp == 0) {
+            comp = collator.compare(model.displayNameAt(left), model.displayNameAt(right));
+        }
+        return comp < 0;
+    });
+    if(order == Qt::DescendingOrder) {
+        std::reverse(rows.begin(), rows.end());
+    }
+
+    if(proxy.sortColumn() != column || proxy.sortOrder() != order || proxy.rowCount() != static_cast<int>(rows.size())) {
+        qDebug() << "the sort was not applied";
+        return false;
+    }
+    for(int row = 0; row < proxy.rowCount(); ++row) {
+        int sourceRow = proxy.mapToSource(proxy.index(row, 0)).row();
+        if(sourceRow != rows[row]) {
+            qDebug() << "row" << row << "is" << model.displayNameAt(sourceRow) << "instead of" << model.displayNameAt(rows[row]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    // above the threshold of the background sort
+    size_t n_files = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50000;
+
+    struct stat st;
+    if(!fakeFileStat(argv[0], st)) {
+        return 1;
+    }
+    auto dirPath = Fm::FilePath::fromLocalPath("/tmp");
+
+    Fm::FileInfoList files;
+    files.reserve(n_files);
+    for(size_t i = 0; i < n_files; ++i) {
+        // not in the order of the names, and many files have the same size
+        st.st_size = (i * 104729) % 1000;
+        auto info = std::make_shared<Fm::FileInfo>();
+        setFakeFileInfo(*info, st, dirPath, i, n_files);
+        files.push_back(std::move(info));
+    }
+
+    TestModel model;
+    model.onFilesAdded(files);
+    model.insertPendingFiles();
+    Fm::ProxyFolderModel proxy;
+    proxy.setSourceModel(&model);
+
+    double secs = sortAndWait(proxy, Fm::FolderModel::ColumnFileSize, Qt::AscendingOrder);
+    qDebug("sort %zu files by size: %.3f s", n_files, secs);
+    if(!checkOrder(proxy, model, Fm::FolderModel::ColumnFileSize, Qt::AscendingOrder)) {
+        return 1;
+    }
+
+    secs = sortAndWait(proxy, Fm::FolderModel::ColumnFileName, Qt::DescendingOrder);
+    qDebug("sort %zu files by name: %.3f s", n_files, secs);
+    if(!checkOrder(proxy, model, Fm::FolderModel::ColumnFileName, Qt::DescendingOrder)) {
+        return 1;
+    }
+
+    // the order applied already is not computed again
+    proxy.sort(Fm::FolderModel::ColumnFileName, Qt::DescendingOrder);
+    if(proxy.isSorting()) {
+        qDebug() << "the rows are sorted again in the same order";
+        return 1;
+    }
+    return 0;
+}